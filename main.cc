@@ -23,6 +23,30 @@
 #include <random>
 #include <chrono>
 #include <string>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <complex>
+#include <list>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // Constants for physics calculations (from online sources)
 namespace PhysicsConstants {
@@ -40,11 +64,258 @@ namespace RenderConfig {
     constexpr int HEIGHT = 600;
     constexpr double FOV = 0.785398;    // 45 degrees in radians
     constexpr int MAX_RAY_STEPS = 500;
-    constexpr double MAX_RAY_DISTANCE = 50.0;
+    constexpr double MAX_RAY_DISTANCE = 50.0;   // Travel allowed beyond the observer's own distance to the hole
     constexpr double ADAPTIVE_STEP_FAR = 0.4;
     constexpr double ADAPTIVE_STEP_MEDIUM = 0.2;
     constexpr double ADAPTIVE_STEP_NEAR = 0.1;
     constexpr double ADAPTIVE_STEP_CLOSE = 0.05;
+    constexpr int TRACE_TILE_SIZE = 16;         // Pixels per side of a primary-ray tile
+}
+
+// Lensing-aware upscaling configuration
+namespace UpscaleConfig {
+    constexpr int DEFAULT_FACTOR = 4;                 // Low-res grid spacing in pixels
+    constexpr double MAX_DISK_RADIUS_SPREAD = 0.25;   // In Schwarzschild radii
+    constexpr double MAX_DISK_ANGLE_SPREAD = 0.35;    // Radians of disk azimuth
+    constexpr double MIN_ESCAPE_COSINE = 0.9995;      // ~1.8 degrees between escape directions
+}
+
+// Adaptive quadtree configuration
+namespace QuadtreeConfig {
+    constexpr int ROOT_CELL_SIZE = 16;                // Coarsest cell and largest one allowed to interpolate,
+                                                      // in pixels (power of two)
+}
+
+// Checkerboard preview configuration
+namespace PreviewConfig {
+    constexpr int DEFAULT_FRAMES = 24;                // Frames in a preview orbit
+    constexpr double ORBIT_STEP_DEGREES = 0.1;        // Camera orbit per frame
+    constexpr double MAX_REUSE_MOTION_PIXELS = 4.0;   // Above this, trace the full frame
+}
+
+// Fly-through reprojection configuration
+namespace FlythroughConfig {
+    constexpr int DEFAULT_FRAMES = 48;                // Frames in a fly-through
+    constexpr int PROBE_SPACING = 8;                  // Pixels between validation probes
+    constexpr int MAX_HISTORY_AGE = 16;               // Frames a reprojected outcome may live
+    constexpr double TOLERANCE_SCALE = 4.0;           // Pixel-adjacent hits may diverge more than grid cells
+}
+
+// Batch frame scheduling configuration
+namespace BatchConfig {
+    constexpr int TILE_SIZE = 32;                     // Tile edge in pixels
+    constexpr double DEFAULT_FPS = 24.0;              // Frames per unit of path time
+}
+
+// Parameter sweep configuration
+namespace SweepConfig {
+    constexpr double CANONICAL_KEY_RESOLUTION = 1e6;  // Distance/mass quantization for reuse
+}
+
+// ML dataset generation configuration
+namespace DatasetConfig {
+    constexpr uint32_t FORMAT_VERSION = 1;            // Shard header version
+    constexpr int DEFAULT_SAMPLES = 1024;             // Samples per run
+    constexpr int DEFAULT_SHARD_SIZE = 256;           // Records per shard file
+    constexpr int DEFAULT_RESOLUTION = 64;            // Square image size
+    constexpr double MIN_MASS = 0.5;                  // Log-uniform mass range
+    constexpr double MAX_MASS = 2.0;
+    constexpr double MIN_DISK_INNER = 2.5;            // Disk radii in Schwarzschild radii
+    constexpr double MAX_DISK_INNER = 4.0;
+    constexpr double MIN_DISK_OUTER = 8.0;
+    constexpr double MAX_DISK_OUTER = 14.0;
+    constexpr double MIN_DISTANCE = 15.0;             // Observer distance in units of mass
+    constexpr double MAX_DISTANCE = 40.0;
+    constexpr double MAX_ELEVATION = 1.2;             // Radians above or below the disk
+}
+
+// Multi-lens scene configuration
+namespace MultiLensConfig {
+    constexpr int BVH_LEAF_SIZE = 2;                  // Lenses per BVH leaf
+    constexpr int MAX_ACTIVE_LENSES = 16;             // Overlapping lenses considered per step
+    constexpr int MAX_RAY_STEPS = 1000;               // Steps across the whole scene
+}
+
+// Histogram binning configuration
+namespace HistogramConfig {
+    constexpr int REDUCE_BLOCK = 4096;                // Bins per reduction task
+}
+
+// Microlensing configuration (lengths in Einstein radii of a unit-mass lens)
+namespace MicrolensConfig {
+    constexpr int DEFAULT_LENSES = 10000;             // Point lenses in the field
+    constexpr double DEFAULT_CONVERGENCE = 0.4;       // Surface density in critical units
+    constexpr double DEFAULT_MAP_HALF_WIDTH = 10.0;   // Source-plane map extent
+    constexpr int DEFAULT_MAP_RESOLUTION = 512;       // Map pixels per side
+    constexpr double DEFAULT_RAYS_PER_PIXEL = 64.0;   // Unlensed rays per map pixel
+    constexpr double SHOOTING_MARGIN = 1.5;           // Image-plane overshoot beyond the mapped region
+    constexpr double OPENING_ANGLE = 0.5;             // Barnes-Hut node size / distance threshold
+    constexpr int MULTIPOLE_ORDER = 4;                // Highest multipole term per node
+    constexpr int LOCAL_ORDER = 6;                    // Highest term of a patch's far-field series
+    constexpr int PATCH_RAYS = 32;                    // Rays per side sharing one far-field series
+    constexpr int LEAF_SIZE = 8;                      // Lenses per tree leaf
+    constexpr int PARALLEL_BUILD_DEPTH = 3;           // Levels built serially before forking subtrees
+}
+
+// Shadow contour extraction configuration
+namespace ContourConfig {
+    constexpr int DEFAULT_ANGLES = 360;               // Radial directions per contour
+    constexpr double SCAN_STEP_PIXELS = 8.0;          // Outward scan step before bisecting
+    constexpr double DEFAULT_TOLERANCE_PIXELS = 1e-3; // Bisection stops below this bracket
+}
+
+// Point-source image solver configuration
+namespace ImageSolverConfig {
+    constexpr int TABLE_SAMPLES = 8192;               // Deflection table entries
+    constexpr double INFLUENCE_MARGIN = 1.05;         // Table reach beyond the lensing cutoff
+    constexpr int SHADOW_BISECTIONS = 48;             // Iterations locating the capture edge
+    constexpr int ROOT_BISECTIONS = 40;               // Iterations per image inside a table cell
+    constexpr int SOURCE_CHUNK = 4096;                // Sources per parallel task
+    constexpr int DEFAULT_RANDOM_SOURCES = 100000;    // Sources when no list is given
+}
+
+// Star catalog configuration
+namespace CatalogConfig {
+    constexpr uint32_t FORMAT_VERSION = 1;            // Binary catalog version
+    constexpr int DEFAULT_NSIDE = 256;                // HEALPix resolution (pixels ~0.23 degrees)
+    constexpr uint32_t MAX_NSIDE = 8192;              // Largest accepted (805M pixels, a 6.4 GB offset table)
+    constexpr double REFERENCE_MAGNITUDE = 2.0;       // Magnitude that fills REFERENCE_SOLID_ANGLE at 1.0
+    constexpr double REFERENCE_SOLID_ANGLE = 1e-4;    // Steradians (a 10 mrad patch)
+    constexpr double KERNEL_RADIUS_SIGMAS = 3.0;      // Gaussian filter support
+    constexpr int MAX_LOOKUP_RINGS = 4;               // Search radius cap, in HEALPix pixel widths
+    constexpr int MAX_LOOKUP_PIXELS = 128;            // Distinct HEALPix pixels per lookup
+}
+
+// Environment map configuration
+namespace EnvironmentMapConfig {
+    constexpr uint32_t FORMAT_VERSION = 1;            // Binary mip-chain file version
+}
+
+// Baked procedural sky configuration
+namespace CubemapConfig {
+    constexpr uint32_t FORMAT_VERSION = 1;            // Cache file layout version
+    constexpr uint32_t SKY_VERSION = 1;               // Bump when shadeBackground changes
+    constexpr int DEFAULT_FACE_SIZE = 1024;           // Level-0 texels per face side
+    constexpr int BAKE_SAMPLES = 2;                   // Procedural samples per texel side
+}
+
+// Rotating (Kerr) black hole configuration
+namespace KerrConfig {
+    constexpr double DEFAULT_SPIN = 0.9;              // a / M
+    constexpr double STEP_FRACTION = 0.04;            // Coordinate displacement per step relative to r
+    constexpr double FAR_FIELD_RADIUS = 20.0;         // Beyond this (in M) the step fraction grows with r
+    constexpr double MAX_STEP_FRACTION = 0.5;
+    constexpr double MAX_ANGLE_STEP = 0.05;           // Largest theta + phi change per step (radians)
+    constexpr double POLAR_LAMBDA = 1e-4;             // |L/E| below this (in M) is snapped to 0
+    constexpr double PROJECTION_THRESHOLD = 1e-3;     // Re-project velocities this far from turning points
+    constexpr double ESCAPE_RADIUS = 1000.0;          // Rays leaving past this (in M) have escaped
+    constexpr double HORIZON_MARGIN = 1.01;           // Captured inside this multiple of r+
+    constexpr int MAX_STEPS = 5000;
+    constexpr double BEAMING_EXPONENT = 3.0;          // Observed intensity scales as g^3
+}
+
+// Volumetric thick disk configuration
+namespace ThickDiskConfig {
+    constexpr double DEFAULT_ASPECT = 0.1;            // Scale height over radius
+    constexpr double DEFAULT_OPACITY = 1.0;           // Absorption per unit length (M) at unit density
+    constexpr double EMISSIVITY = 3.0;                // Source function over the thin disk's color
+    constexpr double DENSITY_SLOPE = 1.5;             // Midplane density falls as R^-slope
+    constexpr double INNER_TAPER = 0.5;               // Falloff length inside the inner edge (M)
+    constexpr double BOUND_SIGMAS = 3.0;              // Density is treated as zero beyond this many scale heights
+    constexpr double SAMPLES_PER_SCALE_HEIGHT = 2.0;  // Quadrature density inside the volume
+    constexpr double EARLY_TERMINATION = 1e-3;        // Stop once transmittance drops below this
+}
+
+// Out-of-core simulation volume configuration
+namespace GrmhdConfig {
+    constexpr uint32_t FORMAT_VERSION = 2;            // 2: offset table padded to 8 bytes
+    constexpr int CHANNELS = 5;                       // density, temperature, vx, vy, vz
+    constexpr int DEFAULT_BRICK_SIZE = 32;            // Voxels per brick side (plus a one-voxel apron)
+    constexpr uint32_t MAX_BRICK_SIZE = 256;          // Largest brick side accepted when opening a volume
+    constexpr size_t DEFAULT_CACHE_MB = 512;          // Decoded-brick budget
+    constexpr int CACHE_SHARDS = 64;                  // Independently locked LRU shards
+    constexpr size_t PAGE_ALIGNMENT = 4096;           // Brick data starts page aligned
+    constexpr double EMPTY_DENSITY = 1e-6;            // Bricks below this peak density are never loaded
+    constexpr double DEFAULT_OPACITY = 1.0;           // Absorption per unit length (M) at unit density
+    constexpr double EMISSIVITY = 1.5;                // Source function over the disk palette color
+    constexpr double EARLY_TERMINATION = 1e-3;
+}
+
+// Hotspot light curve configuration
+namespace LightCurveConfig {
+    constexpr uint32_t FORMAT_VERSION = 2;            // Lensing map file layout (2: received-photon Kerr tracer)
+    constexpr double DEFAULT_RADIUS = 6.0;            // Spot orbit radius (M)
+    constexpr double DEFAULT_SPOT_SIZE = 0.5;         // Gaussian spot sigma (M)
+    constexpr int DEFAULT_STEPS = 4096;
+    constexpr double DEFAULT_PERIODS = 3.0;
+    constexpr double CUTOFF_SIGMAS = 5.0;             // Pixels this far from the orbit never see the spot
+    constexpr double INTENSITY_EXPONENT = 4.0;        // Bolometric flux scales as g^4
+    constexpr size_t SUM_BLOCK = 4096;                // Pixels per single-precision partial sum
+    constexpr float MIN_EXPONENT = -80.0f;            // Keeps exp() clear of its slow underflow path
+}
+
+// Multi-band rendering configuration
+namespace SpectralConfig {
+    constexpr double SYNCHROTRON_INDEX = 0.7;         // Optically thin radio spectrum I ~ nu^-index
+    constexpr double SYNCHROTRON_RADIAL_SLOPE = 2.0;  // Radio emissivity falls as r^-slope
+}
+
+// Test-particle accretion flow configuration
+namespace ParticleConfig {
+    constexpr int DEFAULT_PARTICLES = 1 << 20;
+    constexpr int DEFAULT_FRAMES = 60;
+    constexpr int DEFAULT_SUBSTEPS = 8;               // Leapfrog steps per frame
+    constexpr double TIME_STEP = 0.5;                 // Leapfrog step (M)
+    constexpr double DRAG = 2e-3;                     // Fractional azimuthal velocity loss per M (drives inflow)
+    constexpr double THICKNESS = 0.02;                // Initial height spread over radius
+    constexpr double SPIRAL_CONTRAST = 0.6;           // Initial two-armed density modulation
+    constexpr double CAPTURE_RADIUS = 1.5;            // Respawn inside this many Schwarzschild radii
+    constexpr double ESCAPE_FACTOR = 1.5;             // ... or beyond this multiple of the outer disk radius
+    constexpr int RADIAL_BINS = 128;
+    constexpr int AZIMUTHAL_BINS = 256;
+    constexpr int CHUNK = 16384;                      // Particles per work item
+}
+
+// Multi-view (stereo / light-field) configuration
+namespace MultiViewConfig {
+    constexpr int DEFAULT_VIEWS = 2;
+    constexpr double DEFAULT_BASELINE = 0.25;         // Outermost eye separation (M)
+    constexpr double THETA_OVERSAMPLING = 4.0;        // Table samples per pixel angle
+    constexpr double DISTANCE_TOLERANCE = 0.01;       // Eye distances closer than this share one slice (M)
+    constexpr double SLICE_SPACING = 0.1;             // Observer distance between table slices (M)
+    constexpr int MAX_SLICES = 16;
+}
+
+// Synthetic interferometry configuration
+namespace InterferometryConfig {
+    constexpr int DEFAULT_PADDING = 2;                // Zero-padding factor before the FFT
+    constexpr int COLUMN_BLOCK = 16;                  // Columns gathered per column-FFT task
+    constexpr double DEFAULT_BEAM_FWHM = 8.0;         // Restoring beam FWHM (pixel heights)
+    constexpr int DEFAULT_BASELINES = 6;              // Default uv coverage: baseline lengths ...
+    constexpr int DEFAULT_POSITION_ANGLES = 24;       // ... times orientations over half a turn
+    constexpr double MAX_UV_FRACTION = 0.5;           // Longest default baseline over the image Nyquist frequency
+}
+
+// Ray-differential footprint configuration
+namespace FootprintConfig {
+    constexpr double DISK_TAP_SPACING = 0.05;         // Largest disk-plane gap between filter taps
+    constexpr int MAX_DISK_TAPS = 4;                  // Filter taps per footprint axis
+    constexpr double MAX_SKY_FOOTPRINT = 0.5;         // Angular radius cap (radians)
+    constexpr double NEIGHBOUR_TOLERANCE = 4.0;       // hitsCoherent scale for adjacent pixels' hits
+}
+
+// Forward star splatting configuration
+namespace SplatConfig {
+    constexpr double SIGMA_PIXELS = 0.6;              // Gaussian splat width
+    constexpr int RADIUS_PIXELS = 2;                  // Splat support
+}
+
+// Celestial-sphere magnification map configuration
+namespace SkyMapConfig {
+    constexpr int DEFAULT_RAYS_PER_AXIS = 1024;       // Observer ray grid per side
+    constexpr double DEFAULT_FOV_DEGREES = 60.0;      // Observer field of view
+    constexpr int DEFAULT_MAP_WIDTH = 1024;           // Equal-area cylindrical map size
+    constexpr int DEFAULT_MAP_HEIGHT = 512;
 }
 
 /**
@@ -214,6 +485,27 @@ public:
         // Generate ray direction
         return (direction_ + right * px + newUp * py).normalize();
     }
+    
+    /**
+     * Inverse of getRayDirection: pixel coordinates seen along a direction.
+     * Returns false for directions behind the camera.
+     */
+    bool projectDirection(const Vec3& dir, int width, int height, double& x, double& y) const {
+        double scale = std::tan(fieldOfView_ * 0.5);
+        Vec3 right = direction_.cross(up_).normalize();
+        Vec3 newUp = right.cross(direction_).normalize();
+        
+        double forward = dir.dot(direction_);
+        if (forward < 1e-9) {
+            return false;
+        }
+        double px = dir.dot(right) / forward;
+        double py = dir.dot(newUp) / forward;
+        
+        x = (px / (scale * aspectRatio_) + 1.0) * 0.5 * width;
+        y = (1.0 - py / scale) * 0.5 * height;
+        return true;
+    }
 };
 
 /**
@@ -229,10 +521,17 @@ private:
 
 public:
     BlackHole(const Vec3& position, double mass)
+        : BlackHole(position, mass, PhysicsConstants::DISK_INNER_MULTIPLIER,
+                    PhysicsConstants::DISK_OUTER_MULTIPLIER) {}
+    
+    /**
+     * Black hole with disk radii given in Schwarzschild radii
+     */
+    BlackHole(const Vec3& position, double mass, double diskInnerMultiplier, double diskOuterMultiplier)
         : position_(position), mass_(mass) {
         schwarzschildRadius_ = PhysicsConstants::SCHWARZSCHILD_MULTIPLIER * mass_;
-        diskInnerRadius_ = PhysicsConstants::DISK_INNER_MULTIPLIER * schwarzschildRadius_;
-        diskOuterRadius_ = PhysicsConstants::DISK_OUTER_MULTIPLIER * schwarzschildRadius_;
+        diskInnerRadius_ = diskInnerMultiplier * schwarzschildRadius_;
+        diskOuterRadius_ = diskOuterMultiplier * schwarzschildRadius_;
     }
     
     // Getters
@@ -260,11 +559,14 @@ public:
     }
     
     /**
-     * Apply gravitational lensing to ray direction
+     * Apply gravitational lensing to ray direction.
+     * Bending is applied over a reference length proportional to the mass,
+     * so the geometry is scale-free like the Schwarzschild metric itself.
      */
     Vec3 applyGravitationalLensing(const Vec3& rayPosition, const Vec3& rayDirection) const {
         Vec3 displacement = rayPosition - position_;
         double distance = displacement.length();
+        double referenceLength = 0.1 * mass_;
         
         // Inside photon sphere - strong deflection
         if (distance < schwarzschildRadius_ * PhysicsConstants::PHOTON_SPHERE_MULTIPLIER) {
@@ -275,7 +577,7 @@ public:
             // Strong deflection near photon sphere
             double deflectionFactor = 1.0 / (distance - schwarzschildRadius_);
             Vec3 towardCenter = (position_ - rayPosition).normalize();
-            return (rayDirection + towardCenter * deflectionFactor * 0.1).normalize();
+            return (rayDirection + towardCenter * deflectionFactor * referenceLength).normalize();
         }
         
         // Distant rays - negligible lensing
@@ -287,13 +589,13 @@ public:
         double deflectionAngle = 2.0 * mass_ / (distance * distance);
         Vec3 towardCenter = (position_ - rayPosition).normalize();
         Vec3 perpendicular = rayDirection.cross(towardCenter).cross(rayDirection).normalize();
-        return (rayDirection + perpendicular * deflectionAngle * 0.1).normalize();
+        return (rayDirection + perpendicular * deflectionAngle * referenceLength).normalize();
     }
     
     /**
-     * Check for accretion disk intersection
+     * Check for intersection with the disk plane, ignoring the disk radii
      */
-    bool intersectsAccretionDisk(const Vec3& rayOrigin, const Vec3& rayDirection, Vec3& intersectionPoint) const {
+    bool intersectsDiskPlane(const Vec3& rayOrigin, const Vec3& rayDirection, Vec3& intersectionPoint) const {
         // Disk lies in XZ plane (Y = 0)
         if (std::abs(rayDirection.y()) < 1e-6) {
             return false; // Ray parallel to disk plane
@@ -301,19 +603,34 @@ public:
         
         // Calculate intersection with Y = 0 plane
         double intersectionTime = (position_.y() - rayOrigin.y()) / rayDirection.y();
-        if (intersectionTime < 0.0 || intersectionTime > 2.0) {
+        if (intersectionTime < 0.0 || intersectionTime > 2.0 * mass_) {
             return false; // Intersection behind ray or too far
         }
         
         intersectionPoint = rayOrigin + rayDirection * intersectionTime;
+        return true;
+    }
+    
+    /**
+     * Check whether a point in the disk plane lies between the disk radii
+     */
+    bool withinAccretionDisk(const Vec3& point) const {
         double distanceFromCenter = std::sqrt(
-            std::pow(intersectionPoint.x() - position_.x(), 2) + 
-            std::pow(intersectionPoint.z() - position_.z(), 2)
+            std::pow(point.x() - position_.x(), 2) + 
+            std::pow(point.z() - position_.z(), 2)
         );
         
         return distanceFromCenter >= diskInnerRadius_ && distanceFromCenter <= diskOuterRadius_;
     }
     
+    /**
+     * Check for accretion disk intersection
+     */
+    bool intersectsAccretionDisk(const Vec3& rayOrigin, const Vec3& rayDirection, Vec3& intersectionPoint) const {
+        return intersectsDiskPlane(rayOrigin, rayDirection, intersectionPoint) &&
+               withinAccretionDisk(intersectionPoint);
+    }
+    
     /**
      * Calculate accretion disk color based on temperature and physics
      */
@@ -337,86 +654,222 @@ public:
         temperature *= turbulence;
         
         // Temperature-based color mapping
-        Color baseColor;
+        Color baseColor = temperatureColor(temperature);
+        
+        return baseColor * temperature * dopplerFactor;
+    }
+
+    /**
+     * Disk palette for a temperature normalized to 1 at the hottest
+     */
+    static Color temperatureColor(double temperature) {
         if (temperature > 0.8) {
-            baseColor = Color(1.0, 0.95, 0.8);  // Hot white
+            return Color(1.0, 0.95, 0.8);  // Hot white
         } else if (temperature > 0.6) {
-            baseColor = Color(1.0, 0.8, 0.4);   // Yellow
+            return Color(1.0, 0.8, 0.4);   // Yellow
         } else if (temperature > 0.4) {
-            baseColor = Color(1.0, 0.6, 0.2);   // Orange
-        } else {
-            baseColor = Color(0.8, 0.3, 0.1);   // Red
+            return Color(1.0, 0.6, 0.2);   // Orange
         }
-        
-        return baseColor * temperature * dopplerFactor;
+        return Color(0.8, 0.3, 0.1);       // Red
+    }
+
+    /**
+     * Accretion disk color box-filtered over the parallelogram spanned by the
+     * footprint axes dPdx and dPdy around point; taps that land outside the
+     * disk radii are left out of the average
+     */
+    Color filteredAccretionDiskColor(const Vec3& point, const Vec3& dPdx, const Vec3& dPdy) const {
+        auto tapsAlong = [](const Vec3& axis) {
+            int taps = int(std::ceil(axis.length() / FootprintConfig::DISK_TAP_SPACING));
+            return std::max(1, std::min(FootprintConfig::MAX_DISK_TAPS, taps));
+        };
+        int tapsX = tapsAlong(dPdx), tapsY = tapsAlong(dPdy);
+        if (tapsX == 1 && tapsY == 1) {
+            return calculateAccretionDiskColor(point);
+        }
+
+        Color sum;
+        int inside = 0;
+        for (int j = 0; j < tapsY; ++j) {
+            for (int i = 0; i < tapsX; ++i) {
+                Vec3 tap = point + dPdx * ((i + 0.5) / tapsX - 0.5) + dPdy * ((j + 0.5) / tapsY - 0.5);
+                if (withinAccretionDisk(tap)) {
+                    sum = sum + calculateAccretionDiskColor(tap);
+                    ++inside;
+                }
+            }
+        }
+        return inside > 0 ? sum * (1.0 / inside) : calculateAccretionDiskColor(point);
     }
 };
 
 /**
- * Ray tracing function
+ * Outcome of a traced geodesic, independent of shading
  */
-Color traceRay(const Vec3& origin, Vec3 direction, const BlackHole& bh) {
+enum class HitType { Horizon, Disk, Escaped };
+
+struct RayHit {
+    HitType type = HitType::Escaped;
+    Vec3 point;                  // Disk intersection point (Disk)
+    Vec3 direction;              // Final propagation direction (Escaped)
+    double hitDistance = 0.0;    // Marcher-to-disk distance when the hit was detected
+    double flareDistance = 0.0;  // Marcher-to-center distance when the hit was detected
+    double pathLength = 0.0;     // Distance marched along the geodesic
+    int lens = 0;                // Hole that produced the hit in multi-lens scenes
+    double redshift = 1.0;       // Observed over emitted photon energy (Kerr disk hits)
+    Color emission;              // Light picked up from volumes along the way
+    double transmittance = 1.0;  // Fraction of the end point's light that gets through them
+};
+
+/**
+ * Adaptive step size for a ray at the given distance from a hole, in units
+ * of the hole's mass
+ */
+double adaptiveStepSize(double distanceToBlackHole, const BlackHole& bh) {
+    double stepSize = RenderConfig::ADAPTIVE_STEP_CLOSE;
+    if (distanceToBlackHole > bh.schwarzschildRadius() * 8.0) {
+        stepSize = RenderConfig::ADAPTIVE_STEP_FAR;
+    } else if (distanceToBlackHole > bh.schwarzschildRadius() * 5.0) {
+        stepSize = RenderConfig::ADAPTIVE_STEP_MEDIUM;
+    } else if (distanceToBlackHole > bh.schwarzschildRadius() * 2.0) {
+        stepSize = RenderConfig::ADAPTIVE_STEP_NEAR;
+    }
+    return stepSize * bh.mass();
+}
+
+/**
+ * Geodesic integration core. Marches the ray with adaptive steps (all
+ * lengths in units of the hole's mass) and calls
+ *   onDiskPlane(hit) -> bool
+ * whenever the disk plane lies within two steps ahead; hit is pre-filled as
+ * a Disk candidate and the visitor returns true to end the ray there.
+ * Every straight segment the ray then travels is passed to
+ *   onSegment(start, direction, length) -> bool
+ * which returns false to end the ray as captured (e.g. once a volume has
+ * gone opaque). Otherwise the ray ends at the horizon or escapes; the
+ * length cap counts from the origin's distance to the hole, so distant
+ * observers still reach it.
+ */
+template <typename DiskPlaneVisitor, typename SegmentVisitor>
+RayHit marchGeodesic(const Vec3& origin, Vec3 direction, const BlackHole& bh, DiskPlaneVisitor&& onDiskPlane,
+                     SegmentVisitor&& onSegment) {
     Vec3 currentPosition = origin;
     double totalDistance = 0.0;
-    
+    double maxDistance = origin.distanceTo(bh.position()) + RenderConfig::MAX_RAY_DISTANCE * bh.mass();
+    RayHit hit;
+
     for (int step = 0; step < RenderConfig::MAX_RAY_STEPS; ++step) {
         double distanceToBlackHole = currentPosition.distanceTo(bh.position());
-        
-        // Adaptive step size
-        double stepSize = RenderConfig::ADAPTIVE_STEP_CLOSE;
-        if (distanceToBlackHole > bh.schwarzschildRadius() * 8.0) {
-            stepSize = RenderConfig::ADAPTIVE_STEP_FAR;
-        } else if (distanceToBlackHole > bh.schwarzschildRadius() * 5.0) {
-            stepSize = RenderConfig::ADAPTIVE_STEP_MEDIUM;
-        } else if (distanceToBlackHole > bh.schwarzschildRadius() * 2.0) {
-            stepSize = RenderConfig::ADAPTIVE_STEP_NEAR;
-        }
-        
+
+        double stepSize = adaptiveStepSize(distanceToBlackHole, bh);
+
         // Check for event horizon
         if (distanceToBlackHole < bh.schwarzschildRadius() * 1.01) {
-            return Color(0, 0, 0); // Event horizon
+            hit.type = HitType::Horizon;
+            hit.pathLength = totalDistance;
+            return hit;
         }
-        
-        // Check disk intersection before moving
+
+        // Check disk plane intersection before moving
         Vec3 intersectionPoint;
-        if (bh.intersectsAccretionDisk(currentPosition, direction, intersectionPoint)) {
+        if (bh.intersectsDiskPlane(currentPosition, direction, intersectionPoint)) {
             double hitDistance = currentPosition.distanceTo(intersectionPoint);
             if (hitDistance < stepSize * 2.0) { // Close enough to disk
-                Color diskColor = bh.calculateAccretionDiskColor(intersectionPoint);
-                double intensity = 1.0 + 0.5 / (1.0 + hitDistance);
-                
-                // Add lens flare effect near event horizon
-                double distToCenter = currentPosition.distanceTo(bh.position());
-                if (distToCenter < bh.schwarzschildRadius() * 4.0) {
-                    double flareStrength = 1.0 / (1.0 + (distToCenter - bh.schwarzschildRadius()));
-                    Color flare = Color(0.8, 0.9, 1.0) * flareStrength * 0.3;
-                    diskColor = diskColor + flare;
+                hit.type = HitType::Disk;
+                hit.point = intersectionPoint;
+                hit.hitDistance = hitDistance;
+                hit.flareDistance = distanceToBlackHole;
+                hit.pathLength = totalDistance + hitDistance;
+                if (onDiskPlane(hit)) {
+                    return hit;
                 }
-                
-                return diskColor * intensity;
             }
         }
-        
+
         // Apply gravitational bending (less frequently)
         if (step % 3 == 0) {
             direction = bh.applyGravitationalLensing(currentPosition, direction);
         }
-        
+
+        if (!onSegment(currentPosition, direction, stepSize)) {
+            hit = RayHit();
+            hit.type = HitType::Horizon;
+            hit.pathLength = totalDistance;
+            return hit;
+        }
+
         currentPosition = currentPosition + direction * stepSize;
         totalDistance += stepSize;
-        
-        if (totalDistance > RenderConfig::MAX_RAY_DISTANCE) {
+
+        if (totalDistance > maxDistance) {
             break;
         }
     }
-    
-    // Stars and nebula
+
+    hit = RayHit();
+    hit.type = HitType::Escaped;
+    hit.direction = direction;
+    hit.pathLength = totalDistance;
+    return hit;
+}
+
+/**
+ * Geodesic integration core without a segment visitor
+ */
+template <typename DiskPlaneVisitor>
+RayHit marchGeodesic(const Vec3& origin, Vec3 direction, const BlackHole& bh, DiskPlaneVisitor&& onDiskPlane) {
+    return marchGeodesic(origin, direction, bh, std::forward<DiskPlaneVisitor>(onDiskPlane),
+                         [](const Vec3&, const Vec3&, double) { return true; });
+}
+
+/**
+ * Geodesic integration: march the ray and report where it ends up
+ */
+RayHit traceGeodesic(const Vec3& origin, Vec3 direction, const BlackHole& bh) {
+    return marchGeodesic(origin, direction, bh, [&bh](const RayHit& hit) {
+        return bh.withinAccretionDisk(hit.point);
+    });
+}
+
+/**
+ * Disk-independent record of a geodesic: every disk-plane candidate the
+ * marcher would test, plus where the ray ends if the disk is transparent.
+ * Resolving it against any disk radii gives the same outcome traceGeodesic
+ * would for that disk.
+ */
+struct GeodesicPath {
+    std::vector<RayHit> diskCandidates;
+    RayHit terminal;
+
+    RayHit resolve(const BlackHole& bh) const {
+        for (const RayHit& candidate : diskCandidates) {
+            if (bh.withinAccretionDisk(candidate.point)) {
+                return candidate;
+            }
+        }
+        return terminal;
+    }
+};
+
+GeodesicPath traceGeodesicPath(const Vec3& origin, Vec3 direction, const BlackHole& bh) {
+    GeodesicPath path;
+    path.terminal = marchGeodesic(origin, direction, bh, [&path](const RayHit& hit) {
+        path.diskCandidates.push_back(hit);
+        return false;
+    });
+    return path;
+}
+
+/**
+ * Background sky (stars and nebula) seen along an escaping direction
+ */
+Color shadeBackground(const Vec3& direction) {
     std::hash<std::string> hasher;
-    std::string seed = std::to_string(int(direction.x() * 1000)) + "," + 
-                       std::to_string(int(direction.y() * 1000)) + "," + 
+    std::string seed = std::to_string(int(direction.x() * 1000)) + "," +
+                       std::to_string(int(direction.y() * 1000)) + "," +
                        std::to_string(int(direction.z() * 1000));
     double noise = double(hasher(seed) % 1000) / 1000.0;
-    
+
     // Brighter stars
     if (noise > 0.994) {
         return Color(1, 1, 1) * (noise - 0.994) * 50;  // Bright white stars
@@ -425,7 +878,7 @@ Color traceRay(const Vec3& origin, Vec3 direction, const BlackHole& bh) {
     } else if (noise > 0.975) {
         return Color(1.0, 0.7, 0.5) * (noise - 0.975) * 8;   // Orange stars
     }
-    
+
     // Subtle nebula background
     std::string nebulaSeed = std::to_string(int(direction.x() * 100)) + "," + std::to_string(int(direction.y() * 100));
     double nebulaNoise = double(hasher(nebulaSeed) % 1000) / 1000.0;
@@ -433,81 +886,6371 @@ Color traceRay(const Vec3& origin, Vec3 direction, const BlackHole& bh) {
         Color nebula = Color(0.1, 0.05, 0.15) * (nebulaNoise - 0.7) * 0.5;
         return Color(0.03, 0.03, 0.08) + nebula;
     }
-    
+
     return Color(0.03, 0.03, 0.08);  // Darker space
 }
 
 /**
- * Main rendering function
+ * Brighten a disk hit's color by viewing distance and add the lens flare
  */
-void render(const Camera& cam, const BlackHole& bh, int w, int h, const std::string& filename) {
-    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
-    
-    std::cout << "Rendering " << w << "x" << h << "...\n";
-    
-    for (int y = 0; y < h; ++y) {
-        if (y % (h / 10) == 0) {
-            std::cout << "Progress: " << (100 * y / h) << "%\n";
-        }
-        
-        for (int x = 0; x < w; ++x) {
-            // Anti-aliasing with 4x supersampling
-            Color pixelSum(0, 0, 0);
-            for (int dx = 0; dx < 2; ++dx) {
-                for (int dy = 0; dy < 2; ++dy) {
-                    double subX = x + (dx + 0.5) * 0.5;
-                    double subY = y + (dy + 0.5) * 0.5;
-                    Vec3 rayDirection = cam.getRayDirection(subX, subY, w, h);
-                    pixelSum = pixelSum + traceRay(cam.position(), rayDirection, bh);
-                }
-            }
-            image[y][x] = (pixelSum * 0.25).enhanceContrast().clamp();
-        }
+Color shadeDiskHit(const RayHit& hit, const BlackHole& bh, Color diskColor) {
+    if (hit.redshift != 1.0) {
+        diskColor = diskColor * std::pow(hit.redshift, KerrConfig::BEAMING_EXPONENT);  // Relativistic beaming
     }
-    
+    double intensity = 1.0 + 0.5 / (1.0 + hit.hitDistance);
+
+    // Add lens flare effect near event horizon
+    if (hit.flareDistance < bh.schwarzschildRadius() * 4.0) {
+        double flareStrength = 1.0 / (1.0 + (hit.flareDistance - bh.schwarzschildRadius()));
+        Color flare = Color(0.8, 0.9, 1.0) * flareStrength * 0.3;
+        diskColor = diskColor + flare;
+    }
+
+    return diskColor * intensity;
+}
+
+/**
+ * Shade a geodesic outcome
+ */
+Color shadeHit(const RayHit& hit, const BlackHole& bh) {
+    if (hit.type == HitType::Horizon) {
+        return Color(0, 0, 0); // Event horizon
+    }
+
+    if (hit.type == HitType::Escaped) {
+        return shadeBackground(hit.direction);
+    }
+
+    return shadeDiskHit(hit, bh, bh.calculateAccretionDiskColor(hit.point));
+}
+
+/**
+ * Background seen along escaping rays. footprint is the angular radius (in
+ * radians) of the sky patch one sample stands for, so implementations can
+ * filter instead of point sampling.
+ */
+class SkyBackground {
+public:
+    virtual ~SkyBackground() = default;
+    virtual Color shade(const Vec3& direction, double footprint) const = 0;
+};
+
+/**
+ * The original hashed stars and nebula (point sampled)
+ */
+class ProceduralSky : public SkyBackground {
+public:
+    Color shade(const Vec3& direction, double) const override {
+        return shadeBackground(direction);
+    }
+};
+
+/**
+ * Shade a geodesic outcome against a given sky
+ */
+Color shadeHit(const RayHit& hit, const BlackHole& bh, const SkyBackground& sky, double footprint) {
+    if (hit.type == HitType::Escaped) {
+        return sky.shade(hit.direction, footprint);
+    }
+    return shadeHit(hit, bh);
+}
+
+/**
+ * What one pixel covers where its ray ends: disk-plane axes to the
+ * neighbouring pixels' hit points, and the angular radius of its patch of sky
+ */
+struct PixelFootprint {
+    Vec3 dPdx, dPdy;
+    double skyRadius = 0.0;
+};
+
+/**
+ * Shade a geodesic outcome with disk and sky lookups filtered over the
+ * pixel's footprint, seen through any volume emission picked up on the way
+ */
+Color shadeHit(const RayHit& hit, const BlackHole& bh, const SkyBackground& sky, const PixelFootprint& footprint) {
+    Color surface = hit.type == HitType::Disk
+                        ? shadeDiskHit(hit, bh, bh.filteredAccretionDiskColor(hit.point, footprint.dPdx, footprint.dPdy))
+                        : shadeHit(hit, bh, sky, footprint.skyRadius);
+    return hit.emission + surface * hit.transmittance;
+}
+
+/**
+ * Ray tracing function
+ */
+Color traceRay(const Vec3& origin, Vec3 direction, const BlackHole& bh) {
+    return shadeHit(traceGeodesic(origin, direction, bh), bh);
+}
+
+/**
+ * Write an image as ASCII PPM
+ */
+void writePPM(const std::string& filename, const std::vector<std::vector<Color>>& image) {
+    int h = int(image.size());
+    int w = h > 0 ? int(image[0].size()) : 0;
+
     std::ofstream file(filename);
     file << "P3\n" << w << " " << h << "\n255\n";
-    
+
     for (int y = 0; y < h; ++y) {
         for (int x = 0; x < w; ++x) {
-            Color& c = image[y][x];
+            const Color& c = image[y][x];
             int r = int(c.r() * 255);
             int g = int(c.g() * 255);
             int b = int(c.b() * 255);
             file << r << " " << g << " " << b << "\n";
         }
     }
-    
+
     file.close();
     std::cout << "Saved " << filename << "\n";
 }
 
 /**
- * Main entry point
+ * Trace a pixel with 2x2 supersampling (4x anti-aliasing)
  */
-int main() {
-    std::cout << "Black Hole Raytracer v2.0 - Maxwell Corwin\n";
-    std::cout << "Enhanced with anti-aliasing, lens flares, and particle effects\n";
-    
-    BlackHole bh(Vec3(0, 0, 0), 1.0);
+Color traceSupersampledPixel(const Camera& cam, const BlackHole& bh, int x, int y, int w, int h) {
+    Color pixelSum(0, 0, 0);
+    for (int dx = 0; dx < 2; ++dx) {
+        for (int dy = 0; dy < 2; ++dy) {
+            double subX = x + (dx + 0.5) * 0.5;
+            double subY = y + (dy + 0.5) * 0.5;
+            Vec3 rayDirection = cam.getRayDirection(subX, subY, w, h);
+            pixelSum = pixelSum + traceRay(cam.position(), rayDirection, bh);
+        }
+    }
+    return pixelSum * 0.25;
+}
+
+/**
+ * Main rendering function
+ */
+void render(const Camera& cam, const BlackHole& bh, int w, int h, const std::string& filename) {
+    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
     
-    // Multiple camera angles
-    std::vector<Vec3> positions = {
-        Vec3(0, 2, -8),    // Original view
-        Vec3(-6, 1, -4),   // Side angle
-        Vec3(0, 5, -6)     // Top-down view
-    };
+    std::cout << "Rendering " << w << "x" << h << "...\n";
     
-    for (int i = 0; i < positions.size(); ++i) {
-        Vec3 camPos = positions[i];
-        Vec3 camDir = (Vec3(0, 0, 0) - camPos).normalize();
-        Vec3 camUp(0, 1, 0);
-        Camera cam(camPos, camDir, camUp, RenderConfig::FOV);
+    int progressInterval = std::max(1, h / 10);
+    for (int y = 0; y < h; ++y) {
+        if (y % progressInterval == 0) {
+            std::cout << "Progress: " << (100 * y / h) << "%\n";
+        }
         
-        std::string filename = "black_hole_" + std::to_string(i + 1) + ".ppm";
-        std::cout << "Rendering view " << (i + 1) << "/" << positions.size() << "...\n";
-        render(cam, bh, RenderConfig::WIDTH, RenderConfig::HEIGHT, filename);
-    }
+        for (int x = 0; x < w; ++x) {
+            image[y][x] = traceSupersampledPixel(cam, bh, x, y, w, h).enhanceContrast().clamp();
+        }
+    }
     
+    writePPM(filename, image);
+}
+
+// =============================================================================
+// Lensing-aware upscaling
+// =============================================================================
+
+/**
+ * Disk-plane polar coordinates of a disk hit, relative to the hole
+ */
+double diskHitRadius(const RayHit& hit, const BlackHole& bh) {
+    double dx = hit.point.x() - bh.position().x();
+    double dz = hit.point.z() - bh.position().z();
+    return std::sqrt(dx * dx + dz * dz);
+}
+
+double diskHitAngle(const RayHit& hit, const BlackHole& bh) {
+    return std::atan2(hit.point.z() - bh.position().z(), hit.point.x() - bh.position().x());
+}
+
+/**
+ * Wrap an angle difference into [-pi, pi]
+ */
+double wrapAngle(double angle) {
+    while (angle > M_PI) angle -= 2.0 * M_PI;
+    while (angle < -M_PI) angle += 2.0 * M_PI;
+    return angle;
+}
+
+/**
+ * Check whether a set of geodesic outcomes can be interpolated safely.
+ * Mixed hit types (shadow edge, disk rim) or diverging hit coordinates
+ * (strong lensing near the photon sphere) mean the cell must be traced.
+ * toleranceScale widens the divergence limits for closely spaced samples.
+ */
+bool hitsCoherent(const RayHit* hits, int count, const BlackHole& bh, double toleranceScale = 1.0) {
+    const RayHit& first = hits[0];
+    for (int i = 1; i < count; ++i) {
+        if (hits[i].type != first.type) {
+            return false;
+        }
+    }
+
+    if (first.type == HitType::Disk) {
+        double r0 = diskHitRadius(first, bh);
+        double phi0 = diskHitAngle(first, bh);
+        for (int i = 1; i < count; ++i) {
+            double dr = std::abs(diskHitRadius(hits[i], bh) - r0);
+            double dphi = std::abs(wrapAngle(diskHitAngle(hits[i], bh) - phi0));
+            if (dr > UpscaleConfig::MAX_DISK_RADIUS_SPREAD * bh.schwarzschildRadius() * toleranceScale ||
+                dphi > UpscaleConfig::MAX_DISK_ANGLE_SPREAD * toleranceScale) {
+                return false;
+            }
+        }
+    } else if (first.type == HitType::Escaped) {
+        for (int i = 1; i < count; ++i) {
+            if (1.0 - hits[i].direction.dot(first.direction) >
+                (1.0 - UpscaleConfig::MIN_ESCAPE_COSINE) * toleranceScale * toleranceScale) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Bilinearly interpolate four coherent geodesic outcomes.
+ * Disk hits are blended in (r, phi) so the interpolated point stays on the
+ * disk; escape directions are blended and renormalized.
+ */
+RayHit interpolateHits(const RayHit& h00, const RayHit& h10, const RayHit& h01, const RayHit& h11,
+                       double fx, double fy, const BlackHole& bh) {
+    double w00 = (1.0 - fx) * (1.0 - fy);
+    double w10 = fx * (1.0 - fy);
+    double w01 = (1.0 - fx) * fy;
+    double w11 = fx * fy;
+
+    RayHit result;
+    result.type = h00.type;
+    result.pathLength = w00 * h00.pathLength + w10 * h10.pathLength +
+                        w01 * h01.pathLength + w11 * h11.pathLength;
+
+    if (result.type == HitType::Disk) {
+        double phi0 = diskHitAngle(h00, bh);
+        double r = w00 * diskHitRadius(h00, bh) + w10 * diskHitRadius(h10, bh) +
+                   w01 * diskHitRadius(h01, bh) + w11 * diskHitRadius(h11, bh);
+        double phi = phi0 + w10 * wrapAngle(diskHitAngle(h10, bh) - phi0) +
+                     w01 * wrapAngle(diskHitAngle(h01, bh) - phi0) +
+                     w11 * wrapAngle(diskHitAngle(h11, bh) - phi0);
+        result.point = bh.position() + Vec3(r * std::cos(phi), 0.0, r * std::sin(phi));
+        result.hitDistance = w00 * h00.hitDistance + w10 * h10.hitDistance +
+                             w01 * h01.hitDistance + w11 * h11.hitDistance;
+        result.flareDistance = w00 * h00.flareDistance + w10 * h10.flareDistance +
+                               w01 * h01.flareDistance + w11 * h11.flareDistance;
+    } else if (result.type == HitType::Escaped) {
+        result.direction = (h00.direction * w00 + h10.direction * w10 +
+                            h01.direction * w01 + h11.direction * w11).normalize();
+    }
+
+    return result;
+}
+
+/**
+ * Upscaled rendering: trace geometry on a grid every `factor` pixels, then
+ * reconstruct full-resolution geodesic outcomes by interpolating hit
+ * coordinates and shade every pixel. Cells whose corners straddle a
+ * discontinuity are traced directly at full resolution.
+ */
+void renderUpscaled(const Camera& cam, const BlackHole& bh, int w, int h, int factor,
+                    const std::string& filename) {
+    factor = std::max(1, factor);
+    int gridW = (w - 1) / factor + 2;
+    int gridH = (h - 1) / factor + 2;
+
+    std::cout << "Rendering " << w << "x" << h << " from " << gridW << "x" << gridH
+              << " geometry grid...\n";
+
+    // Coarse geometry pass at pixel centers of every factor-th pixel
+    std::vector<RayHit> grid(size_t(gridW) * gridH);
+    for (int j = 0; j < gridH; ++j) {
+        for (int i = 0; i < gridW; ++i) {
+            Vec3 rayDirection = cam.getRayDirection(i * factor + 0.5, j * factor + 0.5, w, h);
+            grid[size_t(j) * gridW + i] = traceGeodesic(cam.position(), rayDirection, bh);
+        }
+    }
+    long tracedRays = long(gridW) * gridH;
+
+    // Cells that cross a discontinuity get traced at full resolution
+    int cellsW = gridW - 1;
+    int cellsH = gridH - 1;
+    std::vector<char> cellCoherent(size_t(cellsW) * cellsH);
+    for (int j = 0; j < cellsH; ++j) {
+        for (int i = 0; i < cellsW; ++i) {
+            RayHit corners[4] = {
+                grid[size_t(j) * gridW + i], grid[size_t(j) * gridW + i + 1],
+                grid[size_t(j + 1) * gridW + i], grid[size_t(j + 1) * gridW + i + 1]
+            };
+            cellCoherent[size_t(j) * cellsW + i] = hitsCoherent(corners, 4, bh);
+        }
+    }
+
+    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+    long refinedPixels = 0;
+
+    for (int y = 0; y < h; ++y) {
+        int j = y / factor;
+        double fy = double(y % factor) / factor;
+
+        for (int x = 0; x < w; ++x) {
+            int i = x / factor;
+            double fx = double(x % factor) / factor;
+
+            Color pixel;
+            if (cellCoherent[size_t(j) * cellsW + i]) {
+                RayHit hit = interpolateHits(grid[size_t(j) * gridW + i],
+                                             grid[size_t(j) * gridW + i + 1],
+                                             grid[size_t(j + 1) * gridW + i],
+                                             grid[size_t(j + 1) * gridW + i + 1],
+                                             fx, fy, bh);
+                pixel = shadeHit(hit, bh);
+            } else {
+                pixel = traceSupersampledPixel(cam, bh, x, y, w, h);
+                tracedRays += 4;
+                ++refinedPixels;
+            }
+            image[y][x] = pixel.enhanceContrast().clamp();
+        }
+    }
+
+    std::cout << "Traced " << tracedRays << " rays (" << refinedPixels << " pixels refined, "
+              << (100 * tracedRays / (4L * w * h)) << "% of full supersampled cost)\n";
+
+    writePPM(filename, image);
+}
+
+// =============================================================================
+// Adaptive quadtree refinement
+// =============================================================================
+
+/**
+ * Geodesic outcomes on the pixel-center lattice, filled in by the quadtree.
+ * Nodes past the image edge are kept so root cells can overhang the image.
+ */
+class QuadtreeGeometry {
+private:
+    const Camera& cam_;
+    const BlackHole& bh_;
+    int width_, height_;
+    int nodesW_, nodesH_;
+    std::vector<RayHit> hits_;
+    std::vector<char> state_;   // 0 = unknown, 1 = interpolated, 2 = traced
+    long tracedRays_ = 0;
+
+    size_t index(int x, int y) const { return size_t(y) * nodesW_ + x; }
+
+    const RayHit& node(int x, int y) {
+        size_t i = index(x, y);
+        if (state_[i] != 2) {
+            Vec3 rayDirection = cam_.getRayDirection(x + 0.5, y + 0.5, width_, height_);
+            hits_[i] = traceGeodesic(cam_.position(), rayDirection, bh_);
+            state_[i] = 2;
+            ++tracedRays_;
+        }
+        return hits_[i];
+    }
+
+    void refine(int x0, int y0, int size) {
+        RayHit corners[4] = {
+            node(x0, y0), node(x0 + size, y0), node(x0, y0 + size), node(x0 + size, y0 + size)
+        };
+        if (size == 1) {
+            return;
+        }
+
+        if (!hitsCoherent(corners, 4, bh_)) {
+            int half = size / 2;
+            refine(x0, y0, half);
+            refine(x0 + half, y0, half);
+            refine(x0, y0 + half, half);
+            refine(x0 + half, y0 + half, half);
+            return;
+        }
+
+        // Leaf cell: interpolate every lattice node the cell owns
+        for (int y = y0; y <= y0 + size; ++y) {
+            for (int x = x0; x <= x0 + size; ++x) {
+                size_t i = index(x, y);
+                if (state_[i] == 2) {
+                    continue;
+                }
+                hits_[i] = interpolateHits(corners[0], corners[1], corners[2], corners[3],
+                                           double(x - x0) / size, double(y - y0) / size, bh_);
+                state_[i] = 1;
+            }
+        }
+    }
+
+public:
+    QuadtreeGeometry(const Camera& cam, const BlackHole& bh, int w, int h)
+        : cam_(cam), bh_(bh), width_(w), height_(h) {
+        int root = QuadtreeConfig::ROOT_CELL_SIZE;
+        nodesW_ = ((w - 1) / root + 1) * root + 1;
+        nodesH_ = ((h - 1) / root + 1) * root + 1;
+        hits_.resize(size_t(nodesW_) * nodesH_);
+        state_.assign(size_t(nodesW_) * nodesH_, 0);
+    }
+
+    void build() {
+        int root = QuadtreeConfig::ROOT_CELL_SIZE;
+        for (int y0 = 0; y0 + root < nodesH_; y0 += root) {
+            for (int x0 = 0; x0 + root < nodesW_; x0 += root) {
+                refine(x0, y0, root);
+            }
+        }
+    }
+
+    const RayHit& at(int x, int y) const { return hits_[index(x, y)]; }
+    long tracedRays() const { return tracedRays_; }
+};
+
+/**
+ * Quadtree rendering: trace cell corners, subdivide only where corners
+ * disagree in hit type or their hit coordinates diverge, and interpolate
+ * geodesic outcomes everywhere else before shading at one sample per pixel.
+ */
+void renderQuadtree(const Camera& cam, const BlackHole& bh, int w, int h, const std::string& filename) {
+    std::cout << "Rendering " << w << "x" << h << " with quadtree refinement...\n";
+
+    QuadtreeGeometry geometry(cam, bh, w, h);
+    geometry.build();
+
+    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            image[y][x] = shadeHit(geometry.at(x, y), bh).enhanceContrast().clamp();
+        }
+    }
+
+    std::cout << "Traced " << geometry.tracedRays() << " rays for " << (long(w) * h)
+              << " pixels (" << (100 * geometry.tracedRays() / (long(w) * h)) << "%)\n";
+
+    writePPM(filename, image);
+}
+
+// =============================================================================
+// Checkerboard preview rendering
+// =============================================================================
+
+/**
+ * Rough screen-space motion between two camera poses, in pixels: view
+ * rotation plus the parallax of the focus point caused by translation.
+ */
+double cameraMotionInPixels(const Vec3& previousPosition, const Vec3& previousDirection,
+                            const Camera& current, const Vec3& focus, int h) {
+    double pixelAngle = current.fieldOfView() / h;
+    double cosine = std::min(1.0, std::max(-1.0, previousDirection.dot(current.direction())));
+    double rotation = std::acos(cosine);
+    double focusDistance = std::max(1e-6, current.position().distanceTo(focus));
+    double parallax = current.position().distanceTo(previousPosition) / focusDistance;
+    return (rotation + parallax) / pixelAngle;
+}
+
+/**
+ * Traces half of the pixels per frame in an alternating checkerboard and
+ * reconstructs the other half from the previous frame, clamped to the range
+ * of the freshly traced neighbours. Falls back to a full frame when there
+ * is no history or the camera moved too far for the history to be useful.
+ */
+class CheckerboardRenderer {
+private:
+    int width_, height_;
+    int frameIndex_ = 0;
+    bool hasHistory_ = false;
+    Vec3 previousPosition_;
+    Vec3 previousDirection_;
+    std::vector<Color> history_;   // Linear colors before post-processing
+    long lastTracedPixels_ = 0;
+
+public:
+    CheckerboardRenderer(int w, int h)
+        : width_(w), height_(h), history_(size_t(w) * h) {}
+
+    long lastTracedPixels() const { return lastTracedPixels_; }
+
+    std::vector<std::vector<Color>> renderFrame(const Camera& cam, const BlackHole& bh) {
+        int w = width_, h = height_;
+        bool fullFrame = !hasHistory_ ||
+            cameraMotionInPixels(previousPosition_, previousDirection_, cam, bh.position(), h) >
+                PreviewConfig::MAX_REUSE_MOTION_PIXELS;
+        int parity = frameIndex_ % 2;
+
+        std::vector<Color> current(size_t(w) * h);
+        lastTracedPixels_ = 0;
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                if (fullFrame || (x + y) % 2 == parity) {
+                    current[size_t(y) * w + x] = traceSupersampledPixel(cam, bh, x, y, w, h);
+                    ++lastTracedPixels_;
+                }
+            }
+        }
+
+        if (!fullFrame) {
+            const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    if ((x + y) % 2 == parity) {
+                        continue;
+                    }
+
+                    // Neighbourhood of traced pixels bounds the temporal sample
+                    double minR = 1e30, minG = 1e30, minB = 1e30;
+                    double maxR = -1e30, maxG = -1e30, maxB = -1e30;
+                    for (const auto& offset : offsets) {
+                        int nx = x + offset[0];
+                        int ny = y + offset[1];
+                        if (nx < 0 || ny < 0 || nx >= w || ny >= h) {
+                            continue;
+                        }
+                        const Color& n = current[size_t(ny) * w + nx];
+                        minR = std::min(minR, n.r()); maxR = std::max(maxR, n.r());
+                        minG = std::min(minG, n.g()); maxG = std::max(maxG, n.g());
+                        minB = std::min(minB, n.b()); maxB = std::max(maxB, n.b());
+                    }
+
+                    const Color& previous = history_[size_t(y) * w + x];
+                    current[size_t(y) * w + x] = Color(std::min(maxR, std::max(minR, previous.r())),
+                                                       std::min(maxG, std::max(minG, previous.g())),
+                                                       std::min(maxB, std::max(minB, previous.b())));
+                }
+            }
+        }
+
+        history_ = current;
+        hasHistory_ = true;
+        previousPosition_ = cam.position();
+        previousDirection_ = cam.direction();
+        ++frameIndex_;
+
+        std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                image[y][x] = current[size_t(y) * w + x].enhanceContrast().clamp();
+            }
+        }
+        return image;
+    }
+};
+
+/**
+ * Camera orbiting the origin about the Y axis, looking at the origin
+ */
+Camera orbitCamera(const Vec3& start, double angle, double fov) {
+    double c = std::cos(angle);
+    double s = std::sin(angle);
+    Vec3 position(start.x() * c - start.z() * s, start.y(), start.x() * s + start.z() * c);
+    return Camera(position, (Vec3(0, 0, 0) - position).normalize(), Vec3(0, 1, 0), fov);
+}
+
+// =============================================================================
+// Temporal reprojection for fly-throughs
+// =============================================================================
+
+/**
+ * Check that a reprojected outcome agrees with a freshly traced probe
+ */
+bool hitsAgree(const RayHit& a, const RayHit& b, const BlackHole& bh) {
+    RayHit pair[2] = {a, b};
+    return hitsCoherent(pair, 2, bh, FlythroughConfig::TOLERANCE_SCALE);
+}
+
+/**
+ * Reuses the previous frame's geodesic outcomes for a moving camera. Each
+ * pixel is mapped back into the previous frame through its apparent depth
+ * (distance marched to the hit; escaped rays are at infinity), the
+ * previous outcomes are interpolated there, and a sparse grid of probe rays
+ * validates the result. Blocks around failing probes, pixels that map
+ * outside the previous frame or across a discontinuity, and pixels whose
+ * history is too old are traced again.
+ */
+class TemporalReprojector {
+private:
+    int width_, height_;
+    bool hasHistory_ = false;
+    Camera previousCamera_;
+    std::vector<RayHit> history_;
+    std::vector<int> age_;
+    long lastTracedRays_ = 0;
+
+    size_t index(int x, int y) const { return size_t(y) * width_ + x; }
+
+    /**
+     * Interpolate the previous outcomes at pixel coordinates (x, y)
+     */
+    bool sampleHistory(double x, double y, const BlackHole& bh, RayHit& result, int& age) const {
+        // History is stored at pixel centers
+        double gx = x - 0.5;
+        double gy = y - 0.5;
+        int x0 = int(std::floor(gx));
+        int y0 = int(std::floor(gy));
+        if (x0 < 0 || y0 < 0 || x0 + 1 >= width_ || y0 + 1 >= height_) {
+            return false;
+        }
+
+        RayHit corners[4] = {
+            history_[index(x0, y0)], history_[index(x0 + 1, y0)],
+            history_[index(x0, y0 + 1)], history_[index(x0 + 1, y0 + 1)]
+        };
+        if (!hitsCoherent(corners, 4, bh, FlythroughConfig::TOLERANCE_SCALE)) {
+            return false;
+        }
+
+        result = interpolateHits(corners[0], corners[1], corners[2], corners[3], gx - x0, gy - y0, bh);
+        age = std::max(std::max(age_[index(x0, y0)], age_[index(x0 + 1, y0)]),
+                       std::max(age_[index(x0, y0 + 1)], age_[index(x0 + 1, y0 + 1)])) + 1;
+        return true;
+    }
+
+    bool reproject(const Camera& cam, const BlackHole& bh, int x, int y, RayHit& result, int& age) const {
+        Vec3 rayDirection = cam.getRayDirection(x + 0.5, y + 0.5, width_, height_);
+        const Camera& previous = previousCamera_;
+
+        // Fixed-point iteration on the apparent depth, seeded with this pixel's history
+        RayHit guess = history_[index(x, y)];
+        Vec3 previousDirection = rayDirection;
+        for (int iteration = 0; iteration < 2; ++iteration) {
+            previousDirection = rayDirection;
+            if (guess.type != HitType::Escaped) {
+                Vec3 apparentPoint = cam.position() + rayDirection * guess.pathLength;
+                previousDirection = (apparentPoint - previous.position()).normalize();
+            }
+
+            double px, py;
+            if (!previous.projectDirection(previousDirection, width_, height_, px, py) ||
+                !sampleHistory(px, py, bh, guess, age)) {
+                return false;
+            }
+        }
+
+        // Re-measure the apparent depth from the new position
+        if (guess.type != HitType::Escaped) {
+            Vec3 apparentPoint = previous.position() + previousDirection * guess.pathLength;
+            guess.pathLength = cam.position().distanceTo(apparentPoint);
+        }
+
+        // Stagger refreshes so aged-out pixels are not all retraced in one frame
+        result = guess;
+        int maxAge = FlythroughConfig::MAX_HISTORY_AGE;
+        return age <= maxAge + (x * 7 + y * 13) % maxAge;
+    }
+
+    RayHit tracePixel(const Camera& cam, const BlackHole& bh, int x, int y) {
+        ++lastTracedRays_;
+        Vec3 rayDirection = cam.getRayDirection(x + 0.5, y + 0.5, width_, height_);
+        return traceGeodesic(cam.position(), rayDirection, bh);
+    }
+
+public:
+    TemporalReprojector(int w, int h)
+        : width_(w), height_(h),
+          previousCamera_(Vec3(), Vec3(0, 0, 1), Vec3(0, 1, 0), RenderConfig::FOV),
+          history_(size_t(w) * h), age_(size_t(w) * h, 0) {}
+
+    long lastTracedRays() const { return lastTracedRays_; }
+
+    std::vector<std::vector<Color>> renderFrame(const Camera& cam, const BlackHole& bh) {
+        int w = width_, h = height_;
+        lastTracedRays_ = 0;
+
+        std::vector<RayHit> current(size_t(w) * h);
+        std::vector<int> currentAge(size_t(w) * h, 0);
+        std::vector<char> valid(size_t(w) * h, 0);
+
+        if (hasHistory_) {
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    valid[index(x, y)] = reproject(cam, bh, x, y, current[index(x, y)], currentAge[index(x, y)]);
+                }
+            }
+
+            // Sparse probes: a disagreeing probe invalidates the block around it
+            int spacing = FlythroughConfig::PROBE_SPACING;
+            for (int py = spacing / 2; py < h; py += spacing) {
+                for (int px = spacing / 2; px < w; px += spacing) {
+                    RayHit probe = tracePixel(cam, bh, px, py);
+                    bool agrees = !valid[index(px, py)] || hitsAgree(probe, current[index(px, py)], bh);
+                    current[index(px, py)] = probe;
+                    currentAge[index(px, py)] = 0;
+                    valid[index(px, py)] = 2;
+                    if (agrees) {
+                        continue;
+                    }
+                    for (int y = py - spacing / 2; y < std::min(h, py + spacing - spacing / 2); ++y) {
+                        for (int x = px - spacing / 2; x < std::min(w, px + spacing - spacing / 2); ++x) {
+                            if (valid[index(x, y)] == 1) {
+                                valid[index(x, y)] = 0;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                if (!valid[index(x, y)]) {
+                    current[index(x, y)] = tracePixel(cam, bh, x, y);
+                    currentAge[index(x, y)] = 0;
+                }
+            }
+        }
+
+        history_ = current;
+        age_ = currentAge;
+        previousCamera_ = cam;
+        hasHistory_ = true;
+
+        std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                image[y][x] = shadeHit(current[index(x, y)], bh).enhanceContrast().clamp();
+            }
+        }
+        return image;
+    }
+};
+
+// =============================================================================
+// Thread pool
+// =============================================================================
+
+/**
+ * Fixed-size worker pool with a shared FIFO task queue
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable taskAvailable_;
+    std::condition_variable idle_;
+    size_t activeTasks_ = 0;
+    bool stopping_ = false;
+
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                taskAvailable_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (stopping_ && tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+                ++activeTasks_;
+            }
+
+            task();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            --activeTasks_;
+            if (tasks_.empty() && activeTasks_ == 0) {
+                idle_.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threadCount) {
+        threadCount = std::max(1u, threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        taskAvailable_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return unsigned(workers_.size()); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        taskAvailable_.notify_one();
+    }
+
+    /**
+     * Block until the queue is drained and every worker is idle
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return tasks_.empty() && activeTasks_ == 0; });
+    }
+};
+
+/**
+ * Run body(i) for i in [0, count) on the pool and wait for completion.
+ * Indices are handed out dynamically, so uneven work balances itself.
+ * Must not be called from inside a pool task.
+ */
+template <typename Body>
+void parallelFor(ThreadPool& pool, int count, Body body) {
+    if (count <= 0) {
+        return;
+    }
+
+    std::atomic<int> next(0);
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    unsigned workers = std::min(pool.size(), unsigned(count));
+    unsigned running = workers;
+
+    for (unsigned w = 0; w < workers; ++w) {
+        pool.submit([&] {
+            for (int i = next++; i < count; i = next++) {
+                body(i);
+            }
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--running == 0) {
+                doneCondition.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCondition.wait(lock, [&] { return running == 0; });
+}
+
+/**
+ * Worker count from --threads, defaulting to the hardware concurrency
+ */
+unsigned threadCountOption(int requested) {
+    if (requested > 0) {
+        return unsigned(requested);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// =============================================================================
+// Keyframed camera paths
+// =============================================================================
+
+struct CameraKeyframe {
+    double time;
+    Vec3 position;
+    Vec3 target;
+    Vec3 up;
+    double fov;   // Radians
+};
+
+/**
+ * Camera path through keyframes, interpolated with a Catmull-Rom spline
+ * (time-weighted tangents, so keyframes need not be evenly spaced).
+ *
+ * File format, one keyframe per line, '#' starts a comment:
+ *   time  px py pz  tx ty tz  ux uy uz  fov_degrees
+ */
+class CameraPath {
+private:
+    std::vector<CameraKeyframe> keys_;
+
+    static double hermite(double p0, double p1, double m0, double m1, double s, double dt) {
+        double s2 = s * s;
+        double s3 = s2 * s;
+        return (2 * s3 - 3 * s2 + 1) * p0 + (s3 - 2 * s2 + s) * dt * m0 +
+               (-2 * s3 + 3 * s2) * p1 + (s3 - s2) * dt * m1;
+    }
+
+    static Vec3 hermite(const Vec3& p0, const Vec3& p1, const Vec3& m0, const Vec3& m1, double s, double dt) {
+        return Vec3(hermite(p0.x(), p1.x(), m0.x(), m1.x(), s, dt),
+                    hermite(p0.y(), p1.y(), m0.y(), m1.y(), s, dt),
+                    hermite(p0.z(), p1.z(), m0.z(), m1.z(), s, dt));
+    }
+
+    // Catmull-Rom tangent at keyframe i for the given member
+    template <typename T, typename Member>
+    T tangent(size_t i, Member member) const {
+        size_t prev = i > 0 ? i - 1 : i;
+        size_t next = i + 1 < keys_.size() ? i + 1 : i;
+        double dt = keys_[next].time - keys_[prev].time;
+        if (dt <= 0.0) {
+            return T();
+        }
+        return (keys_[next].*member - keys_[prev].*member) * (1.0 / dt);
+    }
+
+public:
+    bool load(const std::string& filename) {
+        std::ifstream file(filename);
+        if (!file) {
+            return false;
+        }
+
+        keys_.clear();
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) {
+                line.erase(comment);
+            }
+            double v[11];
+            std::istringstream fields(line);
+            int n = 0;
+            while (n < 11 && fields >> v[n]) {
+                ++n;
+            }
+            if (n == 0) {
+                continue;
+            }
+            if (n != 11) {
+                std::cerr << "Malformed keyframe in " << filename << ": " << line << "\n";
+                return false;
+            }
+            keys_.push_back({v[0], Vec3(v[1], v[2], v[3]), Vec3(v[4], v[5], v[6]),
+                             Vec3(v[7], v[8], v[9]), v[10] * M_PI / 180.0});
+        }
+
+        std::sort(keys_.begin(), keys_.end(),
+                  [](const CameraKeyframe& a, const CameraKeyframe& b) { return a.time < b.time; });
+        return !keys_.empty();
+    }
+
+    double startTime() const { return keys_.front().time; }
+    double endTime() const { return keys_.back().time; }
+
+    Camera sample(double t) const {
+        CameraKeyframe k = keys_.front();
+        if (keys_.size() > 1 && t > keys_.front().time) {
+            size_t i = 0;
+            while (i + 2 < keys_.size() && keys_[i + 1].time < t) {
+                ++i;
+            }
+            const CameraKeyframe& a = keys_[i];
+            const CameraKeyframe& b = keys_[i + 1];
+            double dt = b.time - a.time;
+            double s = dt > 0.0 ? std::min(1.0, (t - a.time) / dt) : 1.0;
+
+            k.position = hermite(a.position, b.position, tangent<Vec3>(i, &CameraKeyframe::position),
+                                 tangent<Vec3>(i + 1, &CameraKeyframe::position), s, dt);
+            k.target = hermite(a.target, b.target, tangent<Vec3>(i, &CameraKeyframe::target),
+                               tangent<Vec3>(i + 1, &CameraKeyframe::target), s, dt);
+            k.up = hermite(a.up, b.up, tangent<Vec3>(i, &CameraKeyframe::up),
+                           tangent<Vec3>(i + 1, &CameraKeyframe::up), s, dt);
+            k.fov = hermite(a.fov, b.fov, tangent<double>(i, &CameraKeyframe::fov),
+                            tangent<double>(i + 1, &CameraKeyframe::fov), s, dt);
+        }
+        return Camera(k.position, (k.target - k.position).normalize(), k.up, k.fov);
+    }
+};
+
+// =============================================================================
+// Batch frame scheduling
+// =============================================================================
+
+/**
+ * Writes a numbered PPM sequence strictly in frame order. Frames finishing
+ * out of order are held until their predecessors have been written; write()
+ * returns how many frames it wrote to disk.
+ */
+class SequenceSink {
+private:
+    std::string prefix_;
+    int nextFrame_ = 0;
+    std::map<int, std::vector<std::vector<Color>>> pending_;
+    std::mutex mutex_;
+
+public:
+    explicit SequenceSink(const std::string& prefix) : prefix_(prefix) {}
+
+    int write(int frame, std::vector<std::vector<Color>> image) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.emplace(frame, std::move(image));
+        int written = 0;
+        for (auto it = pending_.find(nextFrame_); it != pending_.end(); it = pending_.find(nextFrame_)) {
+            char filename[256];
+            std::snprintf(filename, sizeof(filename), "%s_%04d.ppm", prefix_.c_str(), nextFrame_);
+            writePPM(filename, it->second);
+            pending_.erase(it);
+            ++nextFrame_;
+            ++written;
+        }
+        return written;
+    }
+};
+
+/**
+ * Renders a camera path as a frame sequence. Every frame is split into
+ * tiles and all tiles of all in-flight frames share one pool, so workers
+ * never idle at frame boundaries. The BlackHole is built once and shared
+ * read-only by every tile of every frame.
+ */
+void renderCameraPath(const CameraPath& path, const BlackHole& bh, int w, int h, double fps,
+                      ThreadPool& pool, SequenceSink& sink) {
+    int frames = std::max(1, int(std::floor((path.endTime() - path.startTime()) * fps)) + 1);
+    int tile = BatchConfig::TILE_SIZE;
+    int tilesX = (w + tile - 1) / tile;
+    int tilesY = (h + tile - 1) / tile;
+
+    struct FrameJob {
+        std::vector<std::vector<Color>> image;
+        std::atomic<int> remainingTiles;
+        Camera camera;
+        FrameJob(int w, int h, int tiles, const Camera& cam)
+            : image(h, std::vector<Color>(w)), remainingTiles(tiles), camera(cam) {}
+    };
+
+    // Bound memory by limiting the number of frames in flight; a frame holds
+    // its slot until it is written, including while the sink holds it back
+    std::mutex flightMutex;
+    std::condition_variable flightCondition;
+    int inFlight = 0;
+    int maxInFlight = std::max(2, int(pool.size()) * 2);
+
+    auto start = std::chrono::steady_clock::now();
+    std::cout << "Rendering " << frames << " frames at " << w << "x" << h << " on "
+              << pool.size() << " threads...\n";
+
+    for (int frame = 0; frame < frames; ++frame) {
+        {
+            std::unique_lock<std::mutex> lock(flightMutex);
+            flightCondition.wait(lock, [&] { return inFlight < maxInFlight; });
+            ++inFlight;
+        }
+
+        auto job = std::make_shared<FrameJob>(w, h, tilesX * tilesY,
+                                              path.sample(path.startTime() + frame / fps));
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int tx = 0; tx < tilesX; ++tx) {
+                pool.submit([&, job, frame, tx, ty] {
+                    for (int y = ty * tile; y < std::min(h, (ty + 1) * tile); ++y) {
+                        for (int x = tx * tile; x < std::min(w, (tx + 1) * tile); ++x) {
+                            job->image[y][x] = traceSupersampledPixel(job->camera, bh, x, y, w, h)
+                                                   .enhanceContrast().clamp();
+                        }
+                    }
+                    if (--job->remainingTiles == 0) {
+                        int written = sink.write(frame, std::move(job->image));
+                        if (written > 0) {
+                            std::lock_guard<std::mutex> lock(flightMutex);
+                            inFlight -= written;
+                            flightCondition.notify_all();
+                        }
+                    }
+                });
+            }
+        }
+    }
+
+    pool.wait();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << frames << " frames in " << seconds << "s ("
+              << (frames / std::max(seconds, 1e-9)) << " frames/s)\n";
+}
+
+// =============================================================================
+// Mass-scaling parameter sweeps
+// =============================================================================
+
+struct SweepConfiguration {
+    double mass;
+    double diskInnerMultiplier;
+    double diskOuterMultiplier;
+    double distance;   // Observer distance from the hole
+};
+
+/**
+ * Scale a geodesic outcome traced around a unit-mass hole at the origin to
+ * a hole of the given mass at the given position
+ */
+RayHit rescaleHit(const RayHit& hit, double mass, const Vec3& center) {
+    RayHit scaled = hit;
+    scaled.point = center + hit.point * mass;
+    scaled.hitDistance = hit.hitDistance * mass;
+    scaled.flareDistance = hit.flareDistance * mass;
+    scaled.pathLength = hit.pathLength * mass;
+    return scaled;
+}
+
+/**
+ * Renders a grid of (mass, disk radii, observer distance) configurations.
+ * Geometry only depends on distance / mass, so each configuration is
+ * canonicalized to a unit-mass hole and disk-independent geodesic paths are
+ * traced once per unique canonical distance. Every configuration sharing
+ * that geometry is derived by resolving its disk radii against the recorded
+ * paths, rescaling the hits by its mass and shading with its own BlackHole.
+ */
+void renderMassSweep(const std::vector<SweepConfiguration>& configs, const Vec3& viewDirection,
+                     int w, int h, ThreadPool& pool) {
+    // Group configurations by canonical observer distance
+    std::map<long long, std::vector<size_t>> groups;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        double canonicalDistance = configs[i].distance / configs[i].mass;
+        groups[std::llround(canonicalDistance * SweepConfig::CANONICAL_KEY_RESOLUTION)].push_back(i);
+    }
+
+    std::cout << configs.size() << " configurations share " << groups.size()
+              << " unique geometries\n";
+
+    std::ofstream manifest("black_hole_sweep.csv");
+    manifest << "index,mass,disk_inner_multiplier,disk_outer_multiplier,distance,filename\n";
+
+    BlackHole canonicalHole(Vec3(0, 0, 0), 1.0);
+    Vec3 up(0, 1, 0);
+    for (const auto& group : groups) {
+        const SweepConfiguration& first = configs[group.second.front()];
+        Vec3 camPos = viewDirection * (first.distance / first.mass);
+        Camera cam(camPos, (Vec3(0, 0, 0) - camPos).normalize(), up, RenderConfig::FOV);
+
+        // Trace the disk-independent geometry once, 2x2 samples per pixel like render()
+        std::vector<GeodesicPath> paths(size_t(w) * h * 4);
+        parallelFor(pool, h, [&](int y) {
+            for (int x = 0; x < w; ++x) {
+                for (int s = 0; s < 4; ++s) {
+                    double subX = x + (s / 2 + 0.5) * 0.5;
+                    double subY = y + (s % 2 + 0.5) * 0.5;
+                    Vec3 rayDirection = cam.getRayDirection(subX, subY, w, h);
+                    paths[(size_t(y) * w + x) * 4 + s] = traceGeodesicPath(cam.position(), rayDirection, canonicalHole);
+                }
+            }
+        });
+
+        // Re-shade every configuration that shares it
+        for (size_t index : group.second) {
+            const SweepConfiguration& config = configs[index];
+            BlackHole bh(Vec3(0, 0, 0), config.mass, config.diskInnerMultiplier, config.diskOuterMultiplier);
+            BlackHole canonicalDisk(Vec3(0, 0, 0), 1.0, config.diskInnerMultiplier, config.diskOuterMultiplier);
+
+            std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+            parallelFor(pool, h, [&](int y) {
+                for (int x = 0; x < w; ++x) {
+                    Color pixelSum(0, 0, 0);
+                    for (int s = 0; s < 4; ++s) {
+                        RayHit hit = paths[(size_t(y) * w + x) * 4 + s].resolve(canonicalDisk);
+                        pixelSum = pixelSum + shadeHit(rescaleHit(hit, config.mass, bh.position()), bh);
+                    }
+                    image[y][x] = (pixelSum * 0.25).enhanceContrast().clamp();
+                }
+            });
+
+            char filename[64];
+            std::snprintf(filename, sizeof(filename), "black_hole_sweep_%03zu.ppm", index);
+            writePPM(filename, image);
+            manifest << index << "," << config.mass << "," << config.diskInnerMultiplier << ","
+                     << config.diskOuterMultiplier << "," << config.distance << "," << filename << "\n";
+        }
+    }
+}
+
+// =============================================================================
+// ML dataset generation
+// =============================================================================
+
+/**
+ * One randomly sampled scene; the label vector stored with each record
+ */
+struct DatasetSample {
+    double mass;
+    double diskInnerMultiplier;
+    double diskOuterMultiplier;
+    double distance;
+    double elevation;   // Radians above the disk plane
+    double azimuth;     // Radians around the spin axis
+
+    Vec3 cameraPosition() const {
+        return Vec3(distance * std::cos(elevation) * std::sin(azimuth),
+                    distance * std::sin(elevation),
+                    -distance * std::cos(elevation) * std::cos(azimuth));
+    }
+
+    static constexpr int LABEL_COUNT = 6;
+
+    void labels(float* out) const {
+        out[0] = float(mass);
+        out[1] = float(diskInnerMultiplier);
+        out[2] = float(diskOuterMultiplier);
+        out[3] = float(distance);
+        out[4] = float(elevation);
+        out[5] = float(azimuth);
+    }
+};
+
+/**
+ * Draw scene parameters from the dataset distribution. Mass is log-uniform
+ * and the observer distance is uniform in units of the mass.
+ */
+DatasetSample sampleDatasetConfiguration(std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    auto uniform = [&](double lo, double hi) { return lo + (hi - lo) * unit(rng); };
+
+    DatasetSample sample;
+    sample.mass = std::exp(uniform(std::log(DatasetConfig::MIN_MASS), std::log(DatasetConfig::MAX_MASS)));
+    sample.diskInnerMultiplier = uniform(DatasetConfig::MIN_DISK_INNER, DatasetConfig::MAX_DISK_INNER);
+    sample.diskOuterMultiplier = uniform(DatasetConfig::MIN_DISK_OUTER, DatasetConfig::MAX_DISK_OUTER);
+    sample.distance = sample.mass * uniform(DatasetConfig::MIN_DISTANCE, DatasetConfig::MAX_DISTANCE);
+    sample.elevation = uniform(-DatasetConfig::MAX_ELEVATION, DatasetConfig::MAX_ELEVATION);
+    sample.azimuth = uniform(0.0, 2.0 * M_PI);
+    return sample;
+}
+
+/**
+ * Sharded binary dataset writer. Each shard holds up to shardSize
+ * fixed-size records behind a small header:
+ *
+ *   char[4] "BHDS", uint32 version, uint32 record count, uint32 width,
+ *   uint32 height, uint32 channels, uint32 label count, uint32 record bytes
+ *
+ * followed by records of [float32 labels][uint8 RGB pixels, row-major].
+ * Values are in host byte order. The CSV index maps each sample to its
+ * shard and byte offset and repeats its labels.
+ */
+class DatasetWriter {
+private:
+    std::string prefix_;
+    int width_, height_;
+    std::ofstream index_;
+
+public:
+    DatasetWriter(const std::string& prefix, int width, int height)
+        : prefix_(prefix), width_(width), height_(height), index_(prefix + ".index.csv") {
+        index_ << "sample,shard,offset,mass,disk_inner_multiplier,disk_outer_multiplier,"
+                  "distance,elevation,azimuth\n";
+    }
+
+    size_t recordBytes() const {
+        return DatasetSample::LABEL_COUNT * sizeof(float) + size_t(width_) * height_ * 3;
+    }
+
+    void writeShard(int shard, int firstSample, const std::vector<DatasetSample>& samples,
+                    const std::vector<unsigned char>& records) {
+        char filename[512];
+        std::snprintf(filename, sizeof(filename), "%s-%05d.bin", prefix_.c_str(), shard);
+        std::ofstream file(filename, std::ios::binary);
+
+        uint32_t header[7] = {
+            DatasetConfig::FORMAT_VERSION, uint32_t(samples.size()), uint32_t(width_), uint32_t(height_),
+            3u, uint32_t(DatasetSample::LABEL_COUNT), uint32_t(recordBytes())
+        };
+        file.write("BHDS", 4);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size()));
+
+        size_t headerBytes = 4 + sizeof(header);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            const DatasetSample& s = samples[i];
+            index_ << (firstSample + i) << "," << filename << "," << (headerBytes + i * recordBytes()) << ","
+                   << s.mass << "," << s.diskInnerMultiplier << "," << s.diskOuterMultiplier << ","
+                   << s.distance << "," << s.elevation << "," << s.azimuth << "\n";
+        }
+        std::cout << "Wrote " << filename << " (" << samples.size() << " records)\n";
+    }
+};
+
+/**
+ * Render a dataset: sample configurations from a seeded generator, render
+ * each shard's samples in parallel (one sample per task), and write the
+ * shard as a single contiguous block of fixed-size records.
+ */
+void generateDataset(int sampleCount, int shardSize, uint64_t seed, int w, int h,
+                     DatasetWriter& writer, ThreadPool& pool) {
+    std::mt19937_64 rng(seed);
+    size_t recordBytes = writer.recordBytes();
+    size_t labelBytes = DatasetSample::LABEL_COUNT * sizeof(float);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int first = 0, shard = 0; first < sampleCount; first += shardSize, ++shard) {
+        int count = std::min(shardSize, sampleCount - first);
+        std::vector<DatasetSample> samples(count);
+        for (auto& sample : samples) {
+            sample = sampleDatasetConfiguration(rng);
+        }
+
+        std::vector<unsigned char> records(recordBytes * count);
+        parallelFor(pool, count, [&](int i) {
+            const DatasetSample& sample = samples[i];
+            BlackHole bh(Vec3(0, 0, 0), sample.mass, sample.diskInnerMultiplier, sample.diskOuterMultiplier);
+            Vec3 camPos = sample.cameraPosition();
+            Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+
+            unsigned char* record = &records[recordBytes * i];
+            float labels[DatasetSample::LABEL_COUNT];
+            sample.labels(labels);
+            std::memcpy(record, labels, labelBytes);
+
+            unsigned char* pixels = record + labelBytes;
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    Color c = traceSupersampledPixel(cam, bh, x, y, w, h).enhanceContrast().clamp();
+                    *pixels++ = (unsigned char)(c.r() * 255);
+                    *pixels++ = (unsigned char)(c.g() * 255);
+                    *pixels++ = (unsigned char)(c.b() * 255);
+                }
+            }
+        });
+
+        writer.writeShard(shard, first, samples, records);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Generated " << sampleCount << " samples in " << seconds << "s ("
+              << (sampleCount / std::max(seconds, 1e-9)) << " samples/s)\n";
+}
+
+// =============================================================================
+// Multiple black holes with lens culling
+// =============================================================================
+
+/**
+ * Several black holes, each with its own disk. A bounding-volume hierarchy
+ * over the holes' influence spheres (lensing cutoff or disk, whichever is
+ * larger) lets rays visit only the lenses that can affect them.
+ */
+class LensScene {
+private:
+    struct BvhNode {
+        Vec3 boundsMin, boundsMax;   // Bounds of the influence spheres below
+        int left = -1, right = -1;   // Children, -1 for leaves
+        int first = 0, count = 0;    // Range in order_ for leaves
+    };
+
+    std::vector<BlackHole> holes_;
+    std::vector<double> influenceRadius_;
+    std::vector<int> order_;
+    std::vector<BvhNode> nodes_;
+    Vec3 center_;
+    double radius_ = 0.0;            // Bounding sphere of all influence spheres
+    double minMass_ = 0.0;
+
+    static double component(const Vec3& v, int axis) {
+        return axis == 0 ? v.x() : (axis == 1 ? v.y() : v.z());
+    }
+
+    int build(int first, int count) {
+        BvhNode node;
+        double lo[3] = {1e300, 1e300, 1e300};
+        double hi[3] = {-1e300, -1e300, -1e300};
+        for (int i = first; i < first + count; ++i) {
+            const Vec3& p = holes_[order_[i]].position();
+            double r = influenceRadius_[order_[i]];
+            for (int axis = 0; axis < 3; ++axis) {
+                lo[axis] = std::min(lo[axis], component(p, axis) - r);
+                hi[axis] = std::max(hi[axis], component(p, axis) + r);
+            }
+        }
+        node.boundsMin = Vec3(lo[0], lo[1], lo[2]);
+        node.boundsMax = Vec3(hi[0], hi[1], hi[2]);
+
+        int index = int(nodes_.size());
+        nodes_.push_back(node);
+        if (count <= MultiLensConfig::BVH_LEAF_SIZE) {
+            nodes_[index].first = first;
+            nodes_[index].count = count;
+            return index;
+        }
+
+        // Median split along the widest axis
+        int axis = 0;
+        for (int a = 1; a < 3; ++a) {
+            if (hi[a] - lo[a] > hi[axis] - lo[axis]) {
+                axis = a;
+            }
+        }
+        int middle = first + count / 2;
+        std::nth_element(order_.begin() + first, order_.begin() + middle, order_.begin() + first + count,
+                         [&](int a, int b) {
+                             return component(holes_[a].position(), axis) < component(holes_[b].position(), axis);
+                         });
+
+        int left = build(first, middle - first);
+        int right = build(middle, first + count - middle);
+        nodes_[index].left = left;
+        nodes_[index].right = right;
+        return index;
+    }
+
+    static double distanceToBox(const Vec3& p, const BvhNode& node) {
+        double dx = std::max(0.0, std::max(node.boundsMin.x() - p.x(), p.x() - node.boundsMax.x()));
+        double dy = std::max(0.0, std::max(node.boundsMin.y() - p.y(), p.y() - node.boundsMax.y()));
+        double dz = std::max(0.0, std::max(node.boundsMin.z() - p.z(), p.z() - node.boundsMax.z()));
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+public:
+    explicit LensScene(const std::vector<BlackHole>& holes) : holes_(holes) {
+        minMass_ = 1e300;
+        Vec3 sum;
+        for (size_t i = 0; i < holes_.size(); ++i) {
+            const BlackHole& bh = holes_[i];
+            influenceRadius_.push_back(std::max(bh.schwarzschildRadius() * 10.0, bh.diskOuterRadius()) +
+                                       2.0 * RenderConfig::ADAPTIVE_STEP_FAR * bh.mass());
+            order_.push_back(int(i));
+            minMass_ = std::min(minMass_, bh.mass());
+            sum = sum + bh.position();
+        }
+        center_ = sum / double(holes_.size());
+        for (size_t i = 0; i < holes_.size(); ++i) {
+            radius_ = std::max(radius_, center_.distanceTo(holes_[i].position()) + influenceRadius_[i]);
+        }
+        build(0, int(holes_.size()));
+    }
+
+    size_t size() const { return holes_.size(); }
+    const BlackHole& hole(int i) const { return holes_[i]; }
+    const Vec3& center() const { return center_; }
+    double radius() const { return radius_; }
+    double minMass() const { return minMass_; }
+
+    /**
+     * Call fn(lensIndex, distance) for every lens whose influence sphere contains p
+     */
+    template <typename Fn>
+    void forEachLensContaining(const Vec3& p, Fn&& fn) const {
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode& node = nodes_[stack[--top]];
+            if (distanceToBox(p, node) > 0.0) {
+                continue;
+            }
+            if (node.left < 0) {
+                for (int i = node.first; i < node.first + node.count; ++i) {
+                    int lens = order_[i];
+                    double distance = p.distanceTo(holes_[lens].position());
+                    if (distance < influenceRadius_[lens]) {
+                        fn(lens, distance);
+                    }
+                }
+            } else {
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+            }
+        }
+    }
+
+    /**
+     * Distance from p to the nearest influence sphere surface (0 inside one)
+     */
+    double distanceToNearestInfluence(const Vec3& p) const {
+        double best = 1e300;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode& node = nodes_[stack[--top]];
+            if (distanceToBox(p, node) >= best) {
+                continue;
+            }
+            if (node.left < 0) {
+                for (int i = node.first; i < node.first + node.count; ++i) {
+                    int lens = order_[i];
+                    double gap = p.distanceTo(holes_[lens].position()) - influenceRadius_[lens];
+                    best = std::min(best, std::max(0.0, gap));
+                }
+            } else {
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+            }
+        }
+        return best;
+    }
+};
+
+/**
+ * Geodesic integration through a multi-lens scene. Deflection is summed over
+ * the lenses whose influence sphere contains the ray, and the step adapts to
+ * the nearest lens. Between influence spheres the ray jumps straight to the
+ * next sphere, and it escapes as soon as it leaves the scene moving outward.
+ */
+RayHit traceSceneGeodesic(const Vec3& origin, Vec3 direction, const LensScene& scene) {
+    Vec3 currentPosition = origin;
+    double totalDistance = 0.0;
+    RayHit hit;
+
+    int active[MultiLensConfig::MAX_ACTIVE_LENSES];
+    double activeDistance[MultiLensConfig::MAX_ACTIVE_LENSES];
+
+    for (int step = 0; step < MultiLensConfig::MAX_RAY_STEPS; ++step) {
+        int activeCount = 0;
+        scene.forEachLensContaining(currentPosition, [&](int lens, double distance) {
+            if (activeCount < MultiLensConfig::MAX_ACTIVE_LENSES) {
+                active[activeCount] = lens;
+                activeDistance[activeCount] = distance;
+                ++activeCount;
+            }
+        });
+
+        double stepSize;
+        if (activeCount == 0) {
+            Vec3 fromCenter = currentPosition - scene.center();
+            if (fromCenter.length() > scene.radius() && fromCenter.dot(direction) > 0.0) {
+                break; // Left the scene for good
+            }
+            stepSize = std::max(RenderConfig::ADAPTIVE_STEP_FAR * scene.minMass(),
+                                scene.distanceToNearestInfluence(currentPosition));
+        } else {
+            stepSize = 1e300;
+            for (int i = 0; i < activeCount; ++i) {
+                const BlackHole& bh = scene.hole(active[i]);
+
+                // Check for event horizon
+                if (activeDistance[i] < bh.schwarzschildRadius() * 1.01) {
+                    hit.type = HitType::Horizon;
+                    hit.lens = active[i];
+                    hit.pathLength = totalDistance;
+                    return hit;
+                }
+                stepSize = std::min(stepSize, adaptiveStepSize(activeDistance[i], bh));
+            }
+
+            // Check each nearby disk before moving; the closest hit wins
+            double closestHit = stepSize * 2.0;
+            for (int i = 0; i < activeCount; ++i) {
+                const BlackHole& bh = scene.hole(active[i]);
+                Vec3 intersectionPoint;
+                if (bh.intersectsAccretionDisk(currentPosition, direction, intersectionPoint)) {
+                    double hitDistance = currentPosition.distanceTo(intersectionPoint);
+                    if (hitDistance < closestHit) {
+                        closestHit = hitDistance;
+                        hit.type = HitType::Disk;
+                        hit.lens = active[i];
+                        hit.point = intersectionPoint;
+                        hit.hitDistance = hitDistance;
+                        hit.flareDistance = activeDistance[i];
+                        hit.pathLength = totalDistance + hitDistance;
+                    }
+                }
+            }
+            if (hit.type == HitType::Disk) {
+                return hit;
+            }
+
+            // Sum the bending from every nearby lens (less frequently)
+            if (step % 3 == 0) {
+                Vec3 bent = direction;
+                for (int i = 0; i < activeCount; ++i) {
+                    bent = bent + (scene.hole(active[i]).applyGravitationalLensing(currentPosition, direction) - direction);
+                }
+                direction = bent.normalize();
+            }
+        }
+
+        currentPosition = currentPosition + direction * stepSize;
+        totalDistance += stepSize;
+    }
+
+    hit.type = HitType::Escaped;
+    hit.direction = direction;
+    hit.pathLength = totalDistance;
+    return hit;
+}
+
+/**
+ * Render a multi-lens scene with 2x2 supersampling, rows spread over the pool
+ */
+void renderScene(const Camera& cam, const LensScene& scene, int w, int h, const std::string& filename,
+                 ThreadPool& pool) {
+    std::cout << "Rendering " << w << "x" << h << " with " << scene.size() << " lenses...\n";
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+    parallelFor(pool, h, [&](int y) {
+        for (int x = 0; x < w; ++x) {
+            Color pixelSum(0, 0, 0);
+            for (int dx = 0; dx < 2; ++dx) {
+                for (int dy = 0; dy < 2; ++dy) {
+                    Vec3 rayDirection = cam.getRayDirection(x + (dx + 0.5) * 0.5, y + (dy + 0.5) * 0.5, w, h);
+                    RayHit hit = traceSceneGeodesic(cam.position(), rayDirection, scene);
+                    pixelSum = pixelSum + shadeHit(hit, scene.hole(hit.lens));
+                }
+            }
+            image[y][x] = (pixelSum * 0.25).enhanceContrast().clamp();
+        }
+    });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered in " << seconds << "s\n";
+    writePPM(filename, image);
+}
+
+/**
+ * Load holes from a scene file, one per line: x y z mass [inner outer]
+ * (disk radii in Schwarzschild radii, '#' starts a comment). Malformed
+ * lines and non-positive masses are reported and fail the load.
+ */
+bool loadLensScene(const std::string& filename, std::vector<BlackHole>& holes) {
+    std::ifstream file(filename);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        double v[6] = {0.0, 0.0, 0.0, 0.0, PhysicsConstants::DISK_INNER_MULTIPLIER,
+                       PhysicsConstants::DISK_OUTER_MULTIPLIER};
+        std::istringstream fields(line);
+        int n = 0;
+        double value;
+        while (n < 6 && fields >> value) {
+            v[n++] = value;  // Read through value: a failed extraction zeroes its target
+        }
+        if (n == 0 && fields.eof()) {
+            continue;
+        }
+        if ((n != 4 && n != 6) || !(fields >> std::ws).eof()) {
+            std::cerr << "Malformed lens in " << filename << ": " << line << "\n";
+            return false;
+        }
+        if (!(v[3] > 0.0) || !std::isfinite(v[3])) {
+            std::cerr << "Lens mass must be positive in " << filename << ": " << line << "\n";
+            return false;
+        }
+        if (!(v[4] >= 0.0) || !(v[5] > v[4])) {
+            std::cerr << "Lens disk needs 0 <= inner < outer in " << filename << ": " << line << "\n";
+            return false;
+        }
+        holes.emplace_back(Vec3(v[0], v[1], v[2]), v[3], v[4], v[5]);
+    }
+    return !holes.empty();
+}
+
+// =============================================================================
+// Float maps
+// =============================================================================
+
+/**
+ * Floating-point image for scientific outputs (one or three channels)
+ */
+struct FloatImage {
+    int width = 0;
+    int height = 0;
+    int channels = 1;
+    std::vector<float> pixels;
+
+    FloatImage() = default;
+    FloatImage(int w, int h, int c = 1) : width(w), height(h), channels(c), pixels(size_t(w) * h * c, 0.0f) {}
+
+    float& at(int x, int y, int c = 0) { return pixels[(size_t(y) * width + x) * channels + c]; }
+    float at(int x, int y, int c = 0) const { return pixels[(size_t(y) * width + x) * channels + c]; }
+
+    /**
+     * One channel as a single-channel image
+     */
+    FloatImage channel(int c) const {
+        FloatImage plane(width, height, 1);
+        for (size_t i = 0; i < plane.pixels.size(); ++i) {
+            plane.pixels[i] = pixels[i * channels + c];
+        }
+        return plane;
+    }
+};
+
+/**
+ * Write a float image as little-endian PFM (rows stored bottom to top)
+ */
+void writePFM(const std::string& filename, const FloatImage& image) {
+    std::ofstream file(filename, std::ios::binary);
+    file << (image.channels == 3 ? "PF" : "Pf") << "\n" << image.width << " " << image.height << "\n-1.0\n";
+
+    size_t rowFloats = size_t(image.width) * image.channels;
+    for (int y = image.height - 1; y >= 0; --y) {
+        const float* row = image.pixels.data() + size_t(y) * rowFloats;
+        file.write(reinterpret_cast<const char*>(row), std::streamsize(rowFloats * sizeof(float)));
+    }
+
+    file.close();
+    std::cout << "Saved " << filename << "\n";
+}
+
+/**
+ * Per-thread histograms (counts or weights). Each slot is written by a
+ * single task, so binning needs no atomics; the slots are summed afterwards
+ * in parallel over blocks of bins.
+ */
+template <typename Count>
+class SlotHistograms {
+private:
+    int bins_;
+    std::vector<std::vector<Count>> slots_;
+
+public:
+    SlotHistograms(int slotCount, int bins)
+        : bins_(bins), slots_(size_t(std::max(1, slotCount)), std::vector<Count>(size_t(bins), Count(0))) {}
+
+    int slotCount() const { return int(slots_.size()); }
+    Count* slot(int index) { return slots_[index].data(); }
+
+    std::vector<double> reduce(ThreadPool& pool) const {
+        std::vector<double> total(size_t(bins_), 0.0);
+        int blocks = (bins_ + HistogramConfig::REDUCE_BLOCK - 1) / HistogramConfig::REDUCE_BLOCK;
+        parallelFor(pool, blocks, [&](int block) {
+            int begin = block * HistogramConfig::REDUCE_BLOCK;
+            int end = std::min(bins_, begin + HistogramConfig::REDUCE_BLOCK);
+            for (const auto& counts : slots_) {
+                for (int i = begin; i < end; ++i) {
+                    total[i] += counts[i];
+                }
+            }
+        });
+        return total;
+    }
+};
+
+/**
+ * Preview colour for a magnification value (log scale, 0.1x to 100x)
+ */
+Color magnificationColor(double magnification) {
+    double t = (std::log10(std::max(magnification, 1e-3)) + 1.0) / 3.0;
+    t = std::max(0.0, std::min(1.0, t));
+    return Color(1.5 * t, t * t, t * t * t * t).clamp();
+}
+
+/**
+ * Write a magnification map as PFM plus a log-scaled PPM preview
+ */
+void writeMagnificationMap(const std::string& prefix, const FloatImage& map) {
+    writePFM(prefix + ".pfm", map);
+
+    std::vector<std::vector<Color>> preview(map.height, std::vector<Color>(map.width));
+    for (int y = 0; y < map.height; ++y) {
+        for (int x = 0; x < map.width; ++x) {
+            preview[y][x] = magnificationColor(map.at(x, y));
+        }
+    }
+    writePPM(prefix + ".ppm", preview);
+}
+
+// =============================================================================
+// Microlensing field
+// =============================================================================
+
+/**
+ * Point lenses in a thin lens plane. Positions are in Einstein radii of a
+ * unit-mass lens, so a lens of mass m deflects by m / |x - x_i|.
+ */
+struct PointLens {
+    double x, y, mass;
+};
+
+/**
+ * Deflection over a small patch of the lens plane: lenses close to the patch
+ * are summed directly and everything else is folded into a Taylor series in
+ * conj(z - center), so each ray costs a short loop plus a polynomial.
+ */
+struct LocalDeflection {
+    std::complex<double> center;
+    std::complex<double> coefficients[MicrolensConfig::LOCAL_ORDER + 1];
+    std::vector<PointLens> nearLenses;
+
+    void evaluate(double x, double y, double& ax, double& ay) const {
+        std::complex<double> t(x - center.real(), center.imag() - y);  // conj(z - center)
+        std::complex<double> alpha = coefficients[MicrolensConfig::LOCAL_ORDER];
+        for (int j = MicrolensConfig::LOCAL_ORDER - 1; j >= 0; --j) {
+            alpha = alpha * t + coefficients[j];
+        }
+        ax = alpha.real();
+        ay = alpha.imag();
+
+        for (const PointLens& lens : nearLenses) {
+            double dx = x - lens.x;
+            double dy = y - lens.y;
+            double r2 = dx * dx + dy * dy;
+            if (r2 > 0.0) {
+                double scale = lens.mass / r2;
+                ax += dx * scale;
+                ay += dy * scale;
+            }
+        }
+    }
+};
+
+/**
+ * Barnes-Hut quadtree over the lens plane with complex multipole moments.
+ * In complex notation the deflection of a point lens is m / conj(z - z_i);
+ * expanding around a node's centre of mass c gives
+ *   alpha(z) = sum_k a_k / w^(k+1),  w = conj(z - c),  a_k = sum m_i conj(z_i - c)^k
+ * with a_1 = 0. Nodes that look small enough from a patch of rays use the
+ * expansion and the rest are opened. The top levels are built serially and the subtrees
+ * below them in parallel.
+ */
+class LensTree {
+private:
+    using Complex = std::complex<double>;
+
+    struct Node {
+        double halfSize = 0.0;
+        Complex massCenter;                                     // Expansion centre
+        double mass = 0.0;
+        Complex moments[MicrolensConfig::MULTIPOLE_ORDER + 1];  // a_2..a_order used
+        int firstChild = -1;                                    // Four consecutive children, -1 for leaves
+        int first = 0, count = 0;                               // Lens range
+    };
+
+    struct PendingCell {
+        int index, first, count;
+        double cx, cy, half;
+    };
+
+    std::vector<PointLens> lenses_;
+    std::vector<Node> nodes_;
+    double openingAngle_;
+
+    void computeMoments(Node& node) const {
+        Complex weighted;
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            node.mass += lenses_[i].mass;
+            weighted += lenses_[i].mass * Complex(lenses_[i].x, lenses_[i].y);
+        }
+        if (node.mass <= 0.0) {
+            return;
+        }
+        node.massCenter = weighted / node.mass;
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            Complex d = std::conj(Complex(lenses_[i].x, lenses_[i].y) - node.massCenter);
+            Complex power = d * d;
+            for (int k = 2; k <= MicrolensConfig::MULTIPOLE_ORDER; ++k) {
+                node.moments[k] += lenses_[i].mass * power;
+                power *= d;
+            }
+        }
+    }
+
+    /**
+     * Build the node at nodes[index] over lenses_[first, first + count).
+     * With a pending list, recursion stops at the parallel build depth and
+     * the cells there are queued instead.
+     */
+    void buildNode(std::vector<Node>& nodes, int index, int first, int count, double cx, double cy, double half,
+                   int depth, std::vector<PendingCell>* pending) {
+        if (pending && depth == MicrolensConfig::PARALLEL_BUILD_DEPTH) {
+            pending->push_back({index, first, count, cx, cy, half});
+            return;
+        }
+
+        Node node;
+        node.halfSize = half;
+        node.first = first;
+        node.count = count;
+        computeMoments(node);
+
+        if (count > MicrolensConfig::LEAF_SIZE && half > 1e-9) {
+            // Partition the range into the four quadrants (x >= cx is bit 0, y >= cy is bit 1)
+            auto begin = lenses_.begin() + first;
+            auto end = begin + count;
+            auto top = std::partition(begin, end, [&](const PointLens& l) { return l.y < cy; });
+            auto bottomRight = std::partition(begin, top, [&](const PointLens& l) { return l.x < cx; });
+            auto topRight = std::partition(top, end, [&](const PointLens& l) { return l.x < cx; });
+            int bounds[5] = {first, int(bottomRight - lenses_.begin()), int(top - lenses_.begin()),
+                             int(topRight - lenses_.begin()), first + count};
+
+            node.firstChild = int(nodes.size());
+            nodes.resize(nodes.size() + 4);
+            double quarter = half * 0.5;
+            for (int q = 0; q < 4; ++q) {
+                buildNode(nodes, node.firstChild + q, bounds[q], bounds[q + 1] - bounds[q],
+                          cx + ((q & 1) ? quarter : -quarter), cy + ((q & 2) ? quarter : -quarter), quarter,
+                          depth + 1, pending);
+            }
+        }
+
+        nodes[index] = node;
+    }
+
+public:
+    LensTree(std::vector<PointLens> lenses, double openingAngle, ThreadPool& pool)
+        : lenses_(std::move(lenses)), openingAngle_(openingAngle) {
+        double minX = 1e300, maxX = -1e300, minY = 1e300, maxY = -1e300;
+        for (const PointLens& lens : lenses_) {
+            minX = std::min(minX, lens.x);
+            maxX = std::max(maxX, lens.x);
+            minY = std::min(minY, lens.y);
+            maxY = std::max(maxY, lens.y);
+        }
+        double half = 0.5 * std::max(maxX - minX, maxY - minY) + 1e-9;
+
+        std::vector<PendingCell> pending;
+        nodes_.resize(1);
+        buildNode(nodes_, 0, 0, int(lenses_.size()), 0.5 * (minX + maxX), 0.5 * (minY + maxY), half, 0, &pending);
+
+        // Each cell builds into its own array (root at 0), spliced in afterwards
+        std::vector<std::vector<Node>> subtrees(pending.size());
+        parallelFor(pool, int(pending.size()), [&](int i) {
+            const PendingCell& cell = pending[i];
+            subtrees[i].resize(1);
+            buildNode(subtrees[i], 0, cell.first, cell.count, cell.cx, cell.cy, cell.half, 0, nullptr);
+        });
+
+        for (size_t i = 0; i < pending.size(); ++i) {
+            int offset = int(nodes_.size()) - 1;
+            for (size_t n = 0; n < subtrees[i].size(); ++n) {
+                Node node = subtrees[i][n];
+                if (node.firstChild >= 0) {
+                    node.firstChild += offset;
+                }
+                if (n == 0) {
+                    nodes_[pending[i].index] = node;
+                } else {
+                    nodes_.push_back(node);
+                }
+            }
+        }
+
+        std::cout << "Built lens tree: " << lenses_.size() << " lenses, " << nodes_.size() << " nodes, "
+                  << pending.size() << " subtrees built in parallel\n";
+    }
+
+    size_t size() const { return lenses_.size(); }
+
+    /**
+     * Build the local deflection for the square patch centred on (x, y).
+     * A node goes into the far field when its size plus the patch diagonal is
+     * below the opening angle times its distance; the multipole series
+     *   sum_k a_k (W + t)^-(k+1),  W = conj(center - c)
+     * is then re-expanded in t = conj(z - center).
+     */
+    void localDeflection(double x, double y, double patchHalfSize, LocalDeflection& local) const {
+        Complex center(x, y);
+        local.center = center;
+        local.nearLenses.clear();
+        for (int j = 0; j <= MicrolensConfig::LOCAL_ORDER; ++j) {
+            local.coefficients[j] = 0.0;
+        }
+
+        double patchSize = 2.0 * std::sqrt(2.0) * patchHalfSize;
+        int stack[256];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const Node& node = nodes_[stack[--top]];
+            if (node.mass <= 0.0) {
+                continue;
+            }
+
+            Complex offset = center - node.massCenter;
+            if (2.0 * node.halfSize + patchSize < openingAngle_ * std::abs(offset)) {
+                Complex inverse = 1.0 / std::conj(offset);
+                Complex power = inverse;  // W^-(k+1)
+                for (int k = 0; k <= MicrolensConfig::MULTIPOLE_ORDER; ++k) {
+                    if (k != 1) {
+                        Complex term = (k == 0 ? Complex(node.mass) : node.moments[k]) * power;
+                        local.coefficients[0] += term;
+                        for (int j = 1; j <= MicrolensConfig::LOCAL_ORDER; ++j) {
+                            term *= -double(k + j) / j * inverse;
+                            local.coefficients[j] += term;
+                        }
+                    }
+                    power *= inverse;
+                }
+            } else if (node.firstChild >= 0) {
+                for (int q = 0; q < 4; ++q) {
+                    stack[top++] = node.firstChild + q;
+                }
+            } else {
+                local.nearLenses.insert(local.nearLenses.end(), lenses_.begin() + node.first,
+                                        lenses_.begin() + node.first + node.count);
+            }
+        }
+    }
+};
+
+/**
+ * Random point lenses of unit mass, uniform in a disk sized for the given
+ * convergence. A unit mass has Einstein area pi, so kappa = N pi / (pi R^2).
+ */
+std::vector<PointLens> generateLensField(int count, double convergence, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    double radius = std::sqrt(count / convergence);
+
+    std::vector<PointLens> lenses(size_t(std::max(0, count)));
+    for (PointLens& lens : lenses) {
+        double r = radius * std::sqrt(unit(rng));
+        double angle = 2.0 * M_PI * unit(rng);
+        lens = {r * std::cos(angle), r * std::sin(angle), 1.0};
+    }
+    return lenses;
+}
+
+/**
+ * Inverse ray shooting: map a regular grid of image-plane rays through the
+ * lens equation y = x - alpha(x) (plus external shear) and count where they
+ * land on the source plane. Counts relative to the unlensed ray density give
+ * the magnification. Rays are shot in square patches that share one tree
+ * walk for their far field.
+ */
+FloatImage shootMagnificationMap(const LensTree& tree, double shear, double mapHalfWidth, int resolution,
+                                 double shootHalfWidth, int raysPerAxis, ThreadPool& pool) {
+    SlotHistograms<uint32_t> counts(int(pool.size()), resolution * resolution);
+    double raySpacing = 2.0 * shootHalfWidth / raysPerAxis;
+    double binScale = resolution / (2.0 * mapHalfWidth);
+    const int patchRays = MicrolensConfig::PATCH_RAYS;
+    int patchesPerAxis = (raysPerAxis + patchRays - 1) / patchRays;
+    std::atomic<int> nextPatchRow(0);
+
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(pool, counts.slotCount(), [&](int slot) {
+        uint32_t* bins = counts.slot(slot);
+        LocalDeflection local;
+        for (int patchRow = nextPatchRow++; patchRow < patchesPerAxis; patchRow = nextPatchRow++) {
+            for (int patchColumn = 0; patchColumn < patchesPerAxis; ++patchColumn) {
+                int row0 = patchRow * patchRays, column0 = patchColumn * patchRays;
+                int rows = std::min(patchRays, raysPerAxis - row0);
+                int columns = std::min(patchRays, raysPerAxis - column0);
+                tree.localDeflection(-shootHalfWidth + (column0 + 0.5 * columns) * raySpacing,
+                                     -shootHalfWidth + (row0 + 0.5 * rows) * raySpacing,
+                                     0.5 * patchRays * raySpacing, local);
+
+                for (int row = row0; row < row0 + rows; ++row) {
+                    double x2 = -shootHalfWidth + (row + 0.5) * raySpacing;
+                    for (int column = column0; column < column0 + columns; ++column) {
+                        double x1 = -shootHalfWidth + (column + 0.5) * raySpacing;
+                        double a1, a2;
+                        local.evaluate(x1, x2, a1, a2);
+                        double y1 = (1.0 - shear) * x1 - a1;
+                        double y2 = (1.0 + shear) * x2 - a2;
+
+                        double bx = (y1 + mapHalfWidth) * binScale;
+                        double by = (mapHalfWidth - y2) * binScale;
+                        if (bx >= 0.0 && by >= 0.0 && bx < resolution && by < resolution) {
+                            ++bins[int(by) * resolution + int(bx)];
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double rays = double(raysPerAxis) * raysPerAxis;
+    std::cout << "Shot " << rays << " rays in " << seconds << "s (" << (rays / seconds / 1e6) << " Mrays/s)\n";
+
+    std::vector<double> total = counts.reduce(pool);
+    double pixelSize = 2.0 * mapHalfWidth / resolution;
+    double normalization = (raySpacing * raySpacing) / (pixelSize * pixelSize);
+
+    FloatImage map(resolution, resolution);
+    for (size_t i = 0; i < total.size(); ++i) {
+        map.pixels[i] = float(total[i] * normalization);
+    }
+    return map;
+}
+
+// =============================================================================
+// Celestial-sphere magnification maps
+// =============================================================================
+
+/**
+ * Inverse ray shooting through the black hole: a dense grid of observer rays
+ * is traced and the solid angle each escaping ray covers is binned by where it
+ * lands on the celestial sphere. The map uses an equal-area cylindrical
+ * projection (columns in longitude, rows uniform in sin(latitude)), so dividing
+ * by the common bin solid angle gives the magnification of a background sky.
+ * Rays that end on the horizon, or on the disk unless it is transparent, do
+ * not reach the sky.
+ */
+FloatImage shootSkyMagnificationMap(const Camera& cam, const BlackHole& bh, int raysPerAxis, bool transparentDisk,
+                                    int mapWidth, int mapHeight, ThreadPool& pool) {
+    SlotHistograms<double> solidAngle(int(pool.size()), mapWidth * mapHeight);
+    double scale = std::tan(cam.fieldOfView() * 0.5);
+    double spacing = 2.0 * scale / raysPerAxis;
+    std::atomic<int> nextRow(0);
+    std::atomic<long> escaped(0);
+
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(pool, solidAngle.slotCount(), [&](int slot) {
+        double* bins = solidAngle.slot(slot);
+        long slotEscaped = 0;
+        for (int row = nextRow++; row < raysPerAxis; row = nextRow++) {
+            double py = scale - (row + 0.5) * spacing;
+            for (int column = 0; column < raysPerAxis; ++column) {
+                Vec3 rayDirection = cam.getRayDirection(column + 0.5, row + 0.5, raysPerAxis, raysPerAxis);
+                RayHit hit = transparentDisk ? traceGeodesicPath(cam.position(), rayDirection, bh).terminal
+                                             : traceGeodesic(cam.position(), rayDirection, bh);
+                if (hit.type != HitType::Escaped) {
+                    continue;
+                }
+
+                // Solid angle of this ray's cell on the image plane at unit distance
+                double px = -scale + (column + 0.5) * spacing;
+                double radial = 1.0 + px * px + py * py;
+                double cellSolidAngle = spacing * spacing / (radial * std::sqrt(radial));
+
+                Vec3 d = hit.direction;
+                double u = (std::atan2(d.x(), d.z()) + M_PI) / (2.0 * M_PI);
+                double v = 0.5 * (1.0 - std::max(-1.0, std::min(1.0, d.y())));
+                int bx = std::min(mapWidth - 1, int(u * mapWidth));
+                int by = std::min(mapHeight - 1, int(v * mapHeight));
+                bins[by * mapWidth + bx] += cellSolidAngle;
+                ++slotEscaped;
+            }
+        }
+        escaped += slotEscaped;
+    });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double rays = double(raysPerAxis) * raysPerAxis;
+    std::cout << "Traced " << rays << " rays in " << seconds << "s (" << (rays / seconds / 1e6) << " Mrays/s), "
+              << (100.0 * escaped / rays) << "% reached the sky\n";
+
+    std::vector<double> total = solidAngle.reduce(pool);
+    double binSolidAngle = 4.0 * M_PI / (double(mapWidth) * mapHeight);
+    FloatImage map(mapWidth, mapHeight);
+    for (size_t i = 0; i < total.size(); ++i) {
+        map.pixels[i] = float(total[i] / binSolidAngle);
+    }
+    return map;
+}
+
+// =============================================================================
+// Shadow contours
+// =============================================================================
+
+/**
+ * Closed screen-space curve sampled at evenly spaced angles around a centre.
+ * A negative radius marks a direction where the boundary was not found
+ * inside the frame.
+ */
+struct ScreenContour {
+    double centerX = 0.0, centerY = 0.0;
+    std::vector<double> radii;
+};
+
+/**
+ * Boundary of an "inside" region along each radial screen direction from
+ * (cx, cy): scan outward in coarse steps until a sample falls outside, then
+ * bisect the last bracket down to the tolerance. Angles run in parallel.
+ */
+template <typename InsidePredicate>
+ScreenContour extractRadialContour(double cx, double cy, double maxRadius, int angles, double tolerance,
+                                   ThreadPool& pool, InsidePredicate inside) {
+    ScreenContour contour;
+    contour.centerX = cx;
+    contour.centerY = cy;
+    contour.radii.assign(size_t(angles), -1.0);
+
+    parallelFor(pool, angles, [&](int i) {
+        double angle = 2.0 * M_PI * i / angles;
+        double dx = std::cos(angle), dy = std::sin(angle);
+
+        double insideRadius = 0.0;
+        double outsideRadius = -1.0;
+        for (double r = ContourConfig::SCAN_STEP_PIXELS; r <= maxRadius; r += ContourConfig::SCAN_STEP_PIXELS) {
+            if (!inside(cx + r * dx, cy + r * dy)) {
+                outsideRadius = r;
+                break;
+            }
+            insideRadius = r;
+        }
+        if (outsideRadius < 0.0) {
+            return;
+        }
+
+        while (outsideRadius - insideRadius > tolerance) {
+            double middle = 0.5 * (insideRadius + outsideRadius);
+            if (inside(cx + middle * dx, cy + middle * dy)) {
+                insideRadius = middle;
+            } else {
+                outsideRadius = middle;
+            }
+        }
+        contour.radii[i] = 0.5 * (insideRadius + outsideRadius);
+    });
+
+    return contour;
+}
+
+/**
+ * Write contours as CSV rows: contour name, angle index, angle, x, y, radius
+ */
+void writeContours(const std::string& filename, const std::vector<std::pair<std::string, ScreenContour>>& contours) {
+    std::ofstream file(filename);
+    file << "contour,index,angle,x,y,radius\n";
+    for (const auto& named : contours) {
+        const ScreenContour& contour = named.second;
+        int angles = int(contour.radii.size());
+        for (int i = 0; i < angles; ++i) {
+            double r = contour.radii[i];
+            if (r < 0.0) {
+                continue;
+            }
+            double angle = 2.0 * M_PI * i / angles;
+            file << named.first << "," << i << "," << angle << "," << (contour.centerX + r * std::cos(angle)) << ","
+                 << (contour.centerY + r * std::sin(angle)) << "," << r << "\n";
+        }
+    }
+    file.close();
+    std::cout << "Saved " << filename << "\n";
+}
+
+/**
+ * Shadow outline (capture boundary, disk ignored) for a camera, in pixel
+ * coordinates of a w x h frame. Only boundary rays are traced. No photon
+ * ring is extracted: escaping rays in this lensing model are bent by at
+ * most about 1.1 rad, so there are no higher-order (deflection >= pi)
+ * images whose boundary would differ from the shadow's.
+ */
+std::vector<std::pair<std::string, ScreenContour>> extractShadowContours(const Camera& cam, const BlackHole& bh,
+                                                                         int w, int h, int angles, double tolerance,
+                                                                         ThreadPool& pool) {
+    double cx, cy;
+    if (!cam.projectDirection(bh.position() - cam.position(), w, h, cx, cy)) {
+        return {};
+    }
+    double maxRadius = std::sqrt(double(w) * w + double(h) * h);
+    ScreenContour shadow = extractRadialContour(cx, cy, maxRadius, angles, tolerance, pool, [&](double x, double y) {
+        RayHit hit = marchGeodesic(cam.position(), cam.getRayDirection(x, y, w, h), bh,
+                                   [](const RayHit&) { return false; });
+        return hit.type == HitType::Horizon;
+    });
+
+    return {{"shadow", shadow}};
+}
+
+// =============================================================================
+// Lensed images of point sources
+// =============================================================================
+
+/**
+ * Deflection function of one hole for an observer at a fixed distance.
+ * Lensing here is spherically symmetric, so a ray leaving the observer at
+ * angle theta from the hole escapes in the same plane at polar angle
+ * beta(theta) from the observer-to-hole axis. The table samples beta,
+ * unwrapped so it stays continuous through full turns, from the shadow edge
+ * to where lensing switches off; beyond that beta = theta. Samples are
+ * packed towards the shadow edge, where beta changes fastest.
+ */
+class DeflectionTable {
+private:
+    double shadowTheta_ = 0.0;
+    double maxTheta_ = 0.0;
+    std::vector<double> theta_;
+    std::vector<double> beta_;
+    std::vector<double> slope_;   // d beta / d theta at each sample
+
+public:
+    DeflectionTable(const BlackHole& bh, double observerDistance, ThreadPool& pool) {
+        Vec3 observer = bh.position() - Vec3(0, 0, observerDistance);
+        Vec3 axis(0, 0, 1), side(1, 0, 0);
+        double influence = bh.schwarzschildRadius() * 10.0 * ImageSolverConfig::INFLUENCE_MARGIN;
+        maxTheta_ = observerDistance > influence ? std::asin(influence / observerDistance) : M_PI;
+
+        // Rays are straight outside the influence sphere, so distant
+        // observers start marching where the ray enters it; otherwise the
+        // marcher's step budget would run out before reaching the hole
+        auto trace = [&](double theta) {
+            Vec3 direction = axis * std::cos(theta) + side * std::sin(theta);
+            Vec3 start = observer;
+            if (observerDistance > influence) {
+                double closest = observerDistance * std::sin(theta);
+                double entry = observerDistance * std::cos(theta) -
+                               std::sqrt(std::max(0.0, influence * influence - closest * closest));
+                start = observer + direction * entry;
+            }
+            return marchGeodesic(start, direction, bh, [](const RayHit&) { return false; });
+        };
+
+        double low = 0.0, high = maxTheta_;
+        for (int i = 0; i < ImageSolverConfig::SHADOW_BISECTIONS; ++i) {
+            double middle = 0.5 * (low + high);
+            (trace(middle).type == HitType::Horizon ? low : high) = middle;
+        }
+        shadowTheta_ = high;
+
+        int n = ImageSolverConfig::TABLE_SAMPLES;
+        theta_.resize(n);
+        beta_.resize(n);
+        parallelFor(pool, n, [&](int i) {
+            double u = double(i) / (n - 1);
+            theta_[i] = shadowTheta_ + (maxTheta_ - shadowTheta_) * u * u;
+            RayHit hit = trace(theta_[i]);
+            beta_[i] = std::atan2(hit.direction.dot(side), hit.direction.dot(axis));
+        });
+
+        // Unwrap from the weakly lensed end, where beta is close to theta
+        for (int i = n - 2; i >= 0; --i) {
+            double step = beta_[i] - beta_[i + 1];
+            beta_[i] -= 2.0 * M_PI * std::round(step / (2.0 * M_PI));
+        }
+
+        slope_.resize(n);
+        for (int i = 0; i < n; ++i) {
+            int a = std::max(0, i - 1), b = std::min(n - 1, i + 1);
+            slope_[i] = (beta_[b] - beta_[a]) / (theta_[b] - theta_[a]);
+        }
+    }
+
+    double shadowTheta() const { return shadowTheta_; }
+    double maxTheta() const { return maxTheta_; }
+    int size() const { return int(theta_.size()); }
+    double betaAt(int i) const { return beta_[i]; }
+
+    /**
+     * Cubic Hermite interpolation of beta (and its slope) inside cell i
+     */
+    void interpolate(int i, double theta, double& beta, double& slope) const {
+        double h = theta_[i + 1] - theta_[i];
+        double s = (theta - theta_[i]) / h;
+        double s2 = s * s, s3 = s2 * s;
+        beta = (2 * s3 - 3 * s2 + 1) * beta_[i] + (s3 - 2 * s2 + s) * h * slope_[i] +
+               (-2 * s3 + 3 * s2) * beta_[i + 1] + (s3 - s2) * h * slope_[i + 1];
+        slope = ((6 * s2 - 6 * s) * beta_[i] + (3 * s2 - 4 * s + 1) * h * slope_[i] +
+                 (-6 * s2 + 6 * s) * beta_[i + 1] + (3 * s2 - 2 * s) * h * slope_[i + 1]) / h;
+    }
+
+    /**
+     * Solve beta(theta) = target inside cell i by bisection on the interpolant.
+     * Returns false when the cell does not bracket the target.
+     */
+    bool solveInCell(int i, double target, double& theta, double& slope) const {
+        double fa = beta_[i] - target, fb = beta_[i + 1] - target;
+        if ((fa > 0.0) == (fb > 0.0)) {
+            return false;
+        }
+        double a = theta_[i], b = theta_[i + 1];
+        double beta;
+        for (int k = 0; k < ImageSolverConfig::ROOT_BISECTIONS; ++k) {
+            double middle = 0.5 * (a + b);
+            interpolate(i, middle, beta, slope);
+            if ((beta - target > 0.0) == (fa > 0.0)) {
+                a = middle;
+            } else {
+                b = middle;
+            }
+        }
+        theta = 0.5 * (a + b);
+        interpolate(i, theta, beta, slope);
+        return true;
+    }
+};
+
+/**
+ * One lensed image of a point source
+ */
+struct LensedImage {
+    int source;             // Index into the source list
+    int order;              // 0 primary, 1 secondary, 2+ higher photon-ring images
+    Vec3 direction;         // Observer ray direction of the image
+    double magnification;   // Flux ratio to the unlensed source
+    int parity;             // +1 or -1 (mirror-imaged)
+};
+
+/**
+ * All lensed images of the given sky directions for an observer at
+ * observerPosition. A source at polar angle beta_s and azimuth phi_s
+ * around the observer-to-hole axis has images on its own side where
+ * beta(theta) = beta_s - 2 pi k and on the far side where
+ * beta(theta) = -beta_s - 2 pi k. Each target is located by binary search
+ * in every monotone run of the table and refined on the interpolant;
+ * source coordinates are kept as arrays and processed in parallel chunks. Magnification is
+ * sin(theta) / (sin(beta_s) |d beta / d theta|). The disk is ignored.
+ */
+std::vector<LensedImage> solveLensedImages(const DeflectionTable& table, const BlackHole& bh,
+                                           const Vec3& observerPosition, const std::vector<Vec3>& sources,
+                                           ThreadPool& pool) {
+    Vec3 axis = (bh.position() - observerPosition).normalize();
+    Vec3 reference = std::abs(axis.y()) < 0.9 ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+    Vec3 u = axis.cross(reference).normalize();
+    Vec3 v = axis.cross(u);
+
+    // Source coordinates about the axis, structure-of-arrays
+    size_t count = sources.size();
+    std::vector<double> polar(count), azimuth(count), sinPolar(count);
+    for (size_t i = 0; i < count; ++i) {
+        Vec3 s = sources[i].normalize();
+        polar[i] = std::acos(std::max(-1.0, std::min(1.0, s.dot(axis))));
+        azimuth[i] = std::atan2(s.dot(v), s.dot(u));
+        sinPolar[i] = std::max(std::sin(polar[i]), 1e-12);
+    }
+
+    // Split the table into monotone runs so each target needs one binary
+    // search per run rather than a scan over every cell
+    struct MonotoneRun {
+        int first, last;     // Sample range
+        bool increasing;
+        double low, high;
+    };
+    std::vector<MonotoneRun> runs;
+    for (int first = 0; first + 1 < table.size();) {
+        bool increasing = table.betaAt(first + 1) >= table.betaAt(first);
+        int last = first + 1;
+        while (last + 1 < table.size() && (table.betaAt(last + 1) >= table.betaAt(last)) == increasing) {
+            ++last;
+        }
+        double a = table.betaAt(first), b = table.betaAt(last);
+        runs.push_back({first, last, increasing, std::min(a, b), std::max(a, b)});
+        first = last;
+    }
+    double betaMin = 1e300, betaMax = -1e300;
+    for (const MonotoneRun& run : runs) {
+        betaMin = std::min(betaMin, run.low);
+        betaMax = std::max(betaMax, run.high);
+    }
+    int maxTurns = std::max(0, int(std::ceil((M_PI - betaMin) / (2.0 * M_PI))));
+
+    int chunks = int((count + ImageSolverConfig::SOURCE_CHUNK - 1) / ImageSolverConfig::SOURCE_CHUNK);
+    std::vector<std::vector<LensedImage>> chunkImages(size_t(std::max(0, chunks)));
+    parallelFor(pool, chunks, [&](int chunk) {
+        size_t begin = size_t(chunk) * ImageSolverConfig::SOURCE_CHUNK;
+        size_t end = std::min(count, begin + ImageSolverConfig::SOURCE_CHUNK);
+        std::vector<LensedImage>& images = chunkImages[chunk];
+
+        auto emit = [&](size_t i, int order, double theta, double slope, double phi) {
+            Vec3 radial = u * std::cos(phi) + v * std::sin(phi);
+            double magnification = std::sin(theta) / (sinPolar[i] * std::max(std::abs(slope), 1e-300));
+            double parity = (slope > 0.0) == (order % 2 == 0) ? 1 : -1;
+            images.push_back({int(i), order, axis * std::cos(theta) + radial * std::sin(theta), magnification,
+                              int(parity)});
+        };
+
+        for (size_t i = begin; i < end; ++i) {
+            // Weakly lensed primary beyond the table: beta = theta
+            if (polar[i] >= table.maxTheta()) {
+                emit(i, 0, polar[i], 1.0, azimuth[i]);
+            }
+
+            for (int turn = 0; turn <= maxTurns; ++turn) {
+                for (int side = 0; side < 2; ++side) {
+                    double target = (side == 0 ? polar[i] : -polar[i]) - 2.0 * M_PI * turn;
+                    if (target < betaMin || target > betaMax) {
+                        continue;
+                    }
+                    double phi = azimuth[i] + (side == 0 ? 0.0 : M_PI);
+                    for (const MonotoneRun& run : runs) {
+                        if (target < run.low || target > run.high) {
+                            continue;
+                        }
+                        // Last sample on the near side of the target
+                        int a = run.first, b = run.last;
+                        while (b - a > 1) {
+                            int middle = (a + b) / 2;
+                            ((table.betaAt(middle) < target) == run.increasing ? a : b) = middle;
+                        }
+                        double theta, slope;
+                        if (table.solveInCell(a, target, theta, slope)) {
+                            emit(i, 2 * turn + side, theta, slope, phi);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<LensedImage> images;
+    for (const auto& part : chunkImages) {
+        images.insert(images.end(), part.begin(), part.end());
+    }
+    return images;
+}
+
+/**
+ * Load sky directions, one "x y z" per line ('#' starts a comment)
+ */
+bool loadSourceDirections(const std::string& filename, std::vector<Vec3>& sources) {
+    std::ifstream file(filename);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        double x, y, z;
+        if (fields >> x >> y >> z) {
+            sources.push_back(Vec3(x, y, z));
+        }
+    }
+    return !sources.empty();
+}
+
+// =============================================================================
+// Memory-mapped files
+// =============================================================================
+
+/**
+ * Read-only view of a whole file. Uses mmap where available so large data
+ * streams through the page cache; elsewhere the file is read into memory.
+ */
+class MappedFile {
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    std::vector<unsigned char> buffer_;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data_) {
+            munmap(const_cast<unsigned char*>(data_), size_);
+        }
+#endif
+    }
+
+    bool open(const std::string& filename) {
+#ifdef _WIN32
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return false;
+        }
+        buffer_.resize(size_t(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(buffer_.data()), std::streamsize(buffer_.size()));
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        return bool(file);
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        data_ = static_cast<const unsigned char*>(mapping);
+        size_ = size_t(info.st_size);
+        return true;
+#endif
+    }
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+// =============================================================================
+// Star catalog sky
+// =============================================================================
+
+/**
+ * HEALPix NESTED pixel index of a unit direction (nside a power of two).
+ * The pole of the pixelization is +Y, matching the disk normal.
+ */
+uint64_t healpixNested(const Vec3& direction, uint32_t nside) {
+    double z = std::max(-1.0, std::min(1.0, direction.y()));
+    double phi = std::atan2(direction.x(), direction.z());
+    double tt = std::fmod(phi * (2.0 / M_PI) + 4.0, 4.0);
+    double za = std::abs(z);
+    int64_t n = nside;
+
+    int64_t face, ix, iy;
+    if (za <= 2.0 / 3.0) {
+        double temp1 = n * (0.5 + tt);
+        double temp2 = n * z * 0.75;
+        int64_t jp = int64_t(temp1 - temp2);  // Ascending edge line index
+        int64_t jm = int64_t(temp1 + temp2);  // Descending edge line index
+        int64_t ifp = jp / n, ifm = jm / n;
+        face = ifp == ifm ? (ifp | 4) : (ifp < ifm ? ifp : ifm + 8);
+        ix = jm & (n - 1);
+        iy = n - (jp & (n - 1)) - 1;
+    } else {
+        int64_t ntt = std::min<int64_t>(3, int64_t(tt));
+        double tp = tt - ntt;
+        double tmp = n * std::sqrt(3.0 * (1.0 - za));
+        int64_t jp = std::min(n - 1, int64_t(tp * tmp));
+        int64_t jm = std::min(n - 1, int64_t((1.0 - tp) * tmp));
+        if (z >= 0) {
+            face = ntt;
+            ix = n - jm - 1;
+            iy = n - jp - 1;
+        } else {
+            face = ntt + 8;
+            ix = jp;
+            iy = jm;
+        }
+    }
+
+    // Interleave the bits of ix and iy
+    uint64_t index = 0;
+    for (int bit = 0; bit < 32 && (int64_t(1) << bit) < n; ++bit) {
+        index |= uint64_t((ix >> bit) & 1) << (2 * bit);
+        index |= uint64_t((iy >> bit) & 1) << (2 * bit + 1);
+    }
+    return uint64_t(face) * uint64_t(n) * uint64_t(n) + index;
+}
+
+/**
+ * Binary catalog layout: header, then npix + 1 star offsets per HEALPix
+ * pixel, then the stars sorted by pixel.
+ */
+struct CatalogHeader {
+    char magic[4];          // "BHSC"
+    uint32_t version;
+    uint32_t nside;
+    uint32_t starSize;      // sizeof(CatalogStar)
+    uint64_t starCount;
+};
+
+struct CatalogStar {
+    float x, y, z;          // Unit direction
+    float flux;             // Linear brightness (see CatalogConfig)
+    float r, g, b;          // Colour
+    float magnitude;
+};
+
+/**
+ * Approximate star colour from a B-V index
+ */
+Color starColorFromBV(double bv) {
+    double t = std::max(0.0, std::min(1.0, (bv + 0.4) / 2.4));
+    return Color(0.65 + 0.35 * std::min(1.0, 2.0 * t), 0.75 + 0.25 * (1.0 - std::abs(2.0 * t - 0.8)),
+                 1.0 - 0.6 * t);
+}
+
+/**
+ * Convert a CSV catalog (ra_deg, dec_deg, magnitude[, b_v] per line, header
+ * lines skipped) into the binary HEALPix-sorted format
+ */
+bool convertStarCatalog(const std::string& input, const std::string& output, uint32_t nside) {
+    std::ifstream file(input);
+    if (!file) {
+        return false;
+    }
+
+    std::vector<CatalogStar> stars;
+    std::vector<uint64_t> pixels;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        double ra, dec, magnitude, bv = 0.6;
+        if (!(fields >> ra >> dec >> magnitude)) {
+            continue;
+        }
+        fields >> bv;
+
+        ra *= M_PI / 180.0;
+        dec *= M_PI / 180.0;
+        Vec3 direction(std::cos(dec) * std::sin(ra), std::sin(dec), std::cos(dec) * std::cos(ra));
+        double flux = CatalogConfig::REFERENCE_SOLID_ANGLE *
+                      std::pow(10.0, -0.4 * (magnitude - CatalogConfig::REFERENCE_MAGNITUDE));
+        Color color = starColorFromBV(bv);
+        stars.push_back({float(direction.x()), float(direction.y()), float(direction.z()), float(flux),
+                         float(color.r()), float(color.g()), float(color.b()), float(magnitude)});
+        pixels.push_back(healpixNested(direction, nside));
+    }
+
+    // Counting sort by pixel
+    uint64_t pixelCount = 12ull * nside * nside;
+    std::vector<uint64_t> offsets(pixelCount + 1, 0);
+    for (uint64_t pixel : pixels) {
+        ++offsets[pixel + 1];
+    }
+    for (uint64_t p = 0; p < pixelCount; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+    std::vector<CatalogStar> sorted(stars.size());
+    std::vector<uint64_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < stars.size(); ++i) {
+        sorted[cursor[pixels[i]]++] = stars[i];
+    }
+
+    std::ofstream out(output, std::ios::binary);
+    CatalogHeader header = {{'B', 'H', 'S', 'C'}, CatalogConfig::FORMAT_VERSION, nside,
+                            uint32_t(sizeof(CatalogStar)), uint64_t(sorted.size())};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(offsets.data()), std::streamsize(offsets.size() * sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char*>(sorted.data()), std::streamsize(sorted.size() * sizeof(CatalogStar)));
+    if (!out) {
+        return false;
+    }
+
+    std::cout << "Converted " << sorted.size() << " stars into " << pixelCount << " HEALPix pixels (nside "
+              << nside << ")\n";
+    return true;
+}
+
+/**
+ * Sky from a memory-mapped binary star catalog. A lookup gathers the
+ * HEALPix pixels under the footprint (by sampling rings of points around
+ * the direction, so the cost is constant) and sums each star through a
+ * Gaussian of the footprint width, normalized so a star's total flux is
+ * preserved whatever the footprint.
+ */
+class CatalogSky : public SkyBackground {
+private:
+    MappedFile file_;
+    const CatalogHeader* header_ = nullptr;
+    const uint64_t* offsets_ = nullptr;
+    const CatalogStar* stars_ = nullptr;
+    double pixelSize_ = 0.0;   // Typical HEALPix pixel width in radians
+
+public:
+    bool open(const std::string& filename) {
+        if (!file_.open(filename) || file_.size() < sizeof(CatalogHeader)) {
+            return false;
+        }
+        header_ = reinterpret_cast<const CatalogHeader*>(file_.data());
+        if (std::memcmp(header_->magic, "BHSC", 4) != 0 || header_->version != CatalogConfig::FORMAT_VERSION ||
+            header_->starSize != sizeof(CatalogStar)) {
+            return false;
+        }
+        uint32_t nside = header_->nside;
+        if (nside == 0 || (nside & (nside - 1)) != 0 || nside > CatalogConfig::MAX_NSIDE) {
+            return false;
+        }
+        uint64_t pixelCount = 12ull * nside * nside;
+        uint64_t tableEnd = sizeof(CatalogHeader) + (pixelCount + 1) * sizeof(uint64_t);
+        if (file_.size() < tableEnd || header_->starCount > (file_.size() - tableEnd) / sizeof(CatalogStar)) {
+            return false;
+        }
+        offsets_ = reinterpret_cast<const uint64_t*>(file_.data() + sizeof(CatalogHeader));
+        stars_ = reinterpret_cast<const CatalogStar*>(offsets_ + pixelCount + 1);
+
+        // Every pixel's star range must lie inside the star array
+        for (uint64_t p = 0; p < pixelCount; ++p) {
+            if (offsets_[p] > offsets_[p + 1]) {
+                return false;
+            }
+        }
+        if (offsets_[pixelCount] != header_->starCount) {
+            return false;
+        }
+        pixelSize_ = std::sqrt(4.0 * M_PI / double(pixelCount));
+        return true;
+    }
+
+    uint64_t starCount() const { return header_->starCount; }
+    const CatalogStar* stars() const { return stars_; }
+
+    Color shade(const Vec3& direction, double footprint) const override {
+        double sigma = std::max(footprint, 1e-6);
+        double searchRadius = std::min(CatalogConfig::KERNEL_RADIUS_SIGMAS * sigma,
+                                       CatalogConfig::MAX_LOOKUP_RINGS * pixelSize_);
+
+        // Pixels under the search disk: the centre plus rings of samples
+        uint64_t pixels[CatalogConfig::MAX_LOOKUP_PIXELS];
+        int pixelCount = 0;
+        auto addPixel = [&](const Vec3& d) {
+            uint64_t pixel = healpixNested(d, header_->nside);
+            for (int i = 0; i < pixelCount; ++i) {
+                if (pixels[i] == pixel) {
+                    return;
+                }
+            }
+            if (pixelCount < CatalogConfig::MAX_LOOKUP_PIXELS) {
+                pixels[pixelCount++] = pixel;
+            }
+        };
+        addPixel(direction);
+
+        Vec3 reference = std::abs(direction.y()) < 0.9 ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+        Vec3 u = direction.cross(reference).normalize();
+        Vec3 v = direction.cross(u);
+        int rings = std::max(1, int(std::ceil(searchRadius / pixelSize_)));
+        for (int ring = 1; ring <= rings; ++ring) {
+            double radius = searchRadius * ring / rings;
+            int samples = std::max(8, int(std::ceil(4.0 * M_PI * radius / pixelSize_)));
+            for (int k = 0; k < samples; ++k) {
+                double angle = 2.0 * M_PI * k / samples;
+                addPixel((direction + (u * std::cos(angle) + v * std::sin(angle)) * radius).normalize());
+            }
+        }
+
+        // Gaussian-filtered sum of the stars found
+        double inverseTwoSigma2 = 1.0 / (2.0 * sigma * sigma);
+        double normalization = inverseTwoSigma2 / M_PI;
+        double cosSearch = std::cos(searchRadius);
+        Color sum = Color(0.03, 0.03, 0.08);  // Darker space
+        for (int i = 0; i < pixelCount; ++i) {
+            for (uint64_t s = offsets_[pixels[i]]; s < offsets_[pixels[i] + 1]; ++s) {
+                const CatalogStar& star = stars_[s];
+                double cosine = direction.x() * star.x + direction.y() * star.y + direction.z() * star.z;
+                if (cosine < cosSearch) {
+                    continue;
+                }
+                double angle2 = 2.0 * (1.0 - cosine);  // Chord length squared
+                double weight = star.flux * normalization * std::exp(-angle2 * inverseTwoSigma2);
+                sum = sum + Color(star.r, star.g, star.b) * weight;
+            }
+        }
+        return sum;
+    }
+};
+
+/**
+ * Difference between a pixel's hit and its neighbour's along one image
+ * axis, as a disk-plane offset or an escape-direction chord. Prefers the
+ * forward neighbour and falls back to the backward one; false when neither
+ * is coherent with the hit (the pixel straddles a disk or shadow edge, two
+ * lensed images of the disk, or a sky discontinuity).
+ */
+bool hitDifferential(const RayHit& hit, const RayHit* forward, const RayHit* backward, const BlackHole& bh,
+                     Vec3& difference) {
+    auto coherent = [&](const RayHit* neighbour) {
+        RayHit pair[2] = {hit, *neighbour};
+        return hitsCoherent(pair, 2, bh, FootprintConfig::NEIGHBOUR_TOLERANCE);
+    };
+    if (forward && coherent(forward)) {
+        difference = hit.type == HitType::Disk ? forward->point - hit.point : forward->direction - hit.direction;
+        return true;
+    }
+    if (backward && coherent(backward)) {
+        difference = hit.type == HitType::Disk ? hit.point - backward->point : hit.direction - backward->direction;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Morton (Z-order) code of a 3D cell; z = 0 gives the 2D curve
+ */
+uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z = 0) {
+    uint64_t code = 0;
+    for (int bit = 0; bit < 21; ++bit) {
+        code |= uint64_t((x >> bit) & 1) << (3 * bit);
+        code |= uint64_t((y >> bit) & 1) << (3 * bit + 1);
+        code |= uint64_t((z >> bit) & 1) << (3 * bit + 2);
+    }
+    return code;
+}
+
+/**
+ * Tile indices (y * tilesX + x) of a tilesX x tilesY grid in Morton order
+ */
+std::vector<int> mortonTileOrder(int tilesX, int tilesY) {
+    std::vector<int> order(size_t(tilesX) * tilesY);
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = int(i);
+    }
+    std::sort(order.begin(), order.end(), [tilesX](int a, int b) {
+        return mortonCode(uint32_t(a % tilesX), uint32_t(a / tilesX)) <
+               mortonCode(uint32_t(b % tilesX), uint32_t(b / tilesX));
+    });
+    return order;
+}
+
+/**
+ * Primary-ray integrator: camera position and direction in, geodesic outcome out
+ */
+using GeodesicTracer = std::function<RayHit(const Vec3& origin, const Vec3& direction)>;
+
+/**
+ * Render at one sample per pixel against a filtered sky. All primary hits
+ * are traced first (tiles spread over the pool); each pixel's footprint then
+ * comes from its neighbours' hits, a finite-difference ray differential
+ * carried through the full lensing integration. Strongly magnified pixels
+ * near the photon ring therefore filter over the wide patch of sky or disk
+ * they really cover, and edge pixels fall back to the pinhole footprint.
+ */
+void renderWithSky(const Camera& cam, const BlackHole& bh, const SkyBackground& sky, int w, int h,
+                   const std::string& filename, ThreadPool& pool, const GeodesicTracer& trace) {
+    std::cout << "Rendering " << w << "x" << h << " at 1 spp...\n";
+    auto start = std::chrono::steady_clock::now();
+
+    // Primary rays go out in Morton-ordered tiles, so rays traced back to
+    // back stay neighbours and volume-backed tracers keep their caches warm
+    const int tile = RenderConfig::TRACE_TILE_SIZE;
+    int tilesX = (w + tile - 1) / tile, tilesY = (h + tile - 1) / tile;
+    std::vector<int> tileOrder = mortonTileOrder(tilesX, tilesY);
+    std::vector<RayHit> hits(size_t(w) * h);
+    parallelFor(pool, int(tileOrder.size()), [&](int t) {
+        int tx = tileOrder[t] % tilesX, ty = tileOrder[t] / tilesX;
+        for (int y = ty * tile; y < std::min(h, (ty + 1) * tile); ++y) {
+            for (int x = tx * tile; x < std::min(w, (tx + 1) * tile); ++x) {
+                Vec3 rayDirection = cam.getRayDirection(x + 0.5, y + 0.5, w, h);
+                hits[size_t(y) * w + x] = trace(cam.position(), rayDirection);
+            }
+        }
+    });
+
+    double pinhole = std::tan(cam.fieldOfView() * 0.5) / h;  // Half a pixel at the image centre
+    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+    parallelFor(pool, h, [&](int y) {
+        for (int x = 0; x < w; ++x) {
+            const RayHit* row = &hits[size_t(y) * w];
+            const RayHit& hit = row[x];
+            Vec3 du, dv;
+            bool hasU = hitDifferential(hit, x + 1 < w ? &row[x + 1] : nullptr, x > 0 ? &row[x - 1] : nullptr, bh, du);
+            bool hasV = hitDifferential(hit, y + 1 < h ? &row[x + w] : nullptr,
+                                        y > 0 ? &row[x - size_t(w)] : nullptr, bh, dv);
+
+            PixelFootprint footprint;
+            if (hit.type == HitType::Disk) {
+                // With one axis missing, assume a square footprint: the other
+                // axis is the known one turned a quarter in the disk plane
+                Vec3 up(0, 1, 0);
+                footprint.dPdx = hasU ? du : (hasV ? up.cross(dv) : Vec3());
+                footprint.dPdy = hasV ? dv : (hasU ? up.cross(du) : Vec3());
+            } else if (hasU || hasV) {
+                double chord = std::max(hasU ? du.length() : 0.0, hasV ? dv.length() : 0.0);
+                footprint.skyRadius = std::min(FootprintConfig::MAX_SKY_FOOTPRINT, std::max(pinhole, 0.5 * chord));
+            } else {
+                footprint.skyRadius = pinhole;
+            }
+            image[y][x] = shadeHit(hit, bh, sky, footprint).enhanceContrast().clamp();
+        }
+    });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered in " << seconds << "s\n";
+    writePPM(filename, image);
+}
+
+/**
+ * Render at one sample per pixel against a filtered sky with the
+ * Schwarzschild marcher
+ */
+void renderWithSky(const Camera& cam, const BlackHole& bh, const SkyBackground& sky, int w, int h,
+                   const std::string& filename, ThreadPool& pool) {
+    renderWithSky(cam, bh, sky, w, h, filename, pool, [&bh](const Vec3& origin, const Vec3& direction) {
+        return traceGeodesic(origin, direction, bh);
+    });
+}
+
+// =============================================================================
+// Environment map sky
+// =============================================================================
+
+/**
+ * Read a PFM image (colour or greyscale, either byte order) with rows
+ * returned top to bottom
+ */
+bool readPFM(const std::string& filename, FloatImage& image) {
+    std::ifstream file(filename, std::ios::binary);
+    std::string magic;
+    int width = 0, height = 0;
+    double scale = 0.0;
+    if (!(file >> magic >> width >> height >> scale) || (magic != "PF" && magic != "Pf") || width <= 0 ||
+        height <= 0) {
+        return false;
+    }
+    file.get();  // Single whitespace before the raster
+
+    image = FloatImage(width, height, magic == "PF" ? 3 : 1);
+    size_t rowFloats = size_t(width) * image.channels;
+    for (int y = height - 1; y >= 0; --y) {
+        file.read(reinterpret_cast<char*>(image.pixels.data() + size_t(y) * rowFloats),
+                  std::streamsize(rowFloats * sizeof(float)));
+    }
+    if (!file) {
+        return false;
+    }
+
+    // Positive scale means big-endian data
+    uint16_t probe = 1;
+    bool hostLittleEndian = *reinterpret_cast<unsigned char*>(&probe) == 1;
+    if ((scale > 0.0) == hostLittleEndian) {
+        for (float& value : image.pixels) {
+            unsigned char* bytes = reinterpret_cast<unsigned char*>(&value);
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+        }
+    }
+    return true;
+}
+
+/**
+ * Binary environment map: header, one byte offset per mip level, then each
+ * level's RGB floats row by row (top row first)
+ */
+struct EnvironmentMapHeader {
+    char magic[4];          // "BHEM"
+    uint32_t version;
+    uint32_t width;         // Level 0 size
+    uint32_t height;
+    uint32_t levels;
+    uint32_t reserved;
+};
+
+/**
+ * Convert an equirectangular PFM panorama into a mip-chained environment
+ * map. Each level halves the previous one with a box filter (rounding odd
+ * sizes up) and is built in parallel over rows.
+ */
+bool convertEnvironmentMap(const std::string& input, const std::string& output, ThreadPool& pool) {
+    FloatImage source;
+    if (!readPFM(input, source)) {
+        return false;
+    }
+
+    std::vector<FloatImage> levels;
+    levels.push_back(FloatImage(source.width, source.height, 3));
+    for (size_t i = 0; i < size_t(source.width) * source.height; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            levels[0].pixels[i * 3 + c] = source.pixels[i * source.channels + (source.channels == 3 ? c : 0)];
+        }
+    }
+
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const FloatImage& fine = levels.back();
+        FloatImage coarse((fine.width + 1) / 2, (fine.height + 1) / 2, 3);
+        parallelFor(pool, coarse.height, [&](int y) {
+            for (int x = 0; x < coarse.width; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    double sum = 0.0;
+                    int count = 0;
+                    for (int dy = 0; dy < 2; ++dy) {
+                        for (int dx = 0; dx < 2; ++dx) {
+                            int fx = 2 * x + dx, fy = 2 * y + dy;
+                            if (fx < fine.width && fy < fine.height) {
+                                sum += fine.at(fx, fy, c);
+                                ++count;
+                            }
+                        }
+                    }
+                    coarse.at(x, y, c) = float(sum / count);
+                }
+            }
+        });
+        levels.push_back(std::move(coarse));
+    }
+
+    std::ofstream out(output, std::ios::binary);
+    EnvironmentMapHeader header = {{'B', 'H', 'E', 'M'}, EnvironmentMapConfig::FORMAT_VERSION,
+                                   uint32_t(source.width), uint32_t(source.height), uint32_t(levels.size()), 0};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t offset = sizeof(header) + levels.size() * sizeof(uint64_t);
+    for (const FloatImage& level : levels) {
+        out.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+        offset += level.pixels.size() * sizeof(float);
+    }
+    for (const FloatImage& level : levels) {
+        out.write(reinterpret_cast<const char*>(level.pixels.data()),
+                  std::streamsize(level.pixels.size() * sizeof(float)));
+    }
+    if (!out) {
+        return false;
+    }
+
+    std::cout << "Converted " << source.width << "x" << source.height << " panorama into " << levels.size()
+              << " mip levels\n";
+    return true;
+}
+
+/**
+ * Equirectangular HDR sky read straight from a memory-mapped mip chain, so
+ * only the texels actually fetched are paged in. The mip level follows the
+ * footprint: a footprint spanning n level-0 texels reads level log2(n),
+ * blended trilinearly between the two nearest levels. +Y is up and the
+ * left edge of the panorama faces -Z.
+ */
+class EnvironmentMapSky : public SkyBackground {
+private:
+    MappedFile file_;
+    const EnvironmentMapHeader* header_ = nullptr;
+    std::vector<const float*> levelData_;
+    std::vector<int> levelWidth_, levelHeight_;
+
+    Color bilinear(int level, double u, double v) const {
+        int w = levelWidth_[level], h = levelHeight_[level];
+        const float* texels = levelData_[level];
+        double fx = u * w - 0.5, fy = v * h - 0.5;
+        int x0 = int(std::floor(fx)), y0 = int(std::floor(fy));
+        double tx = fx - x0, ty = fy - y0;
+
+        Color result;
+        for (int dy = 0; dy < 2; ++dy) {
+            int y = std::min(h - 1, std::max(0, y0 + dy));
+            for (int dx = 0; dx < 2; ++dx) {
+                int x = ((x0 + dx) % w + w) % w;  // Longitude wraps
+                double weight = (dx ? tx : 1.0 - tx) * (dy ? ty : 1.0 - ty);
+                const float* texel = texels + (size_t(y) * w + x) * 3;
+                result = result + Color(texel[0], texel[1], texel[2]) * weight;
+            }
+        }
+        return result;
+    }
+
+public:
+    bool open(const std::string& filename) {
+        if (!file_.open(filename) || file_.size() < sizeof(EnvironmentMapHeader)) {
+            return false;
+        }
+        header_ = reinterpret_cast<const EnvironmentMapHeader*>(file_.data());
+        if (std::memcmp(header_->magic, "BHEM", 4) != 0 || header_->version != EnvironmentMapConfig::FORMAT_VERSION ||
+            header_->levels == 0 || header_->width == 0 || header_->height == 0 ||
+            header_->width > uint32_t(INT32_MAX) || header_->height > uint32_t(INT32_MAX)) {
+            return false;
+        }
+
+        // At most the full mip chain down to 1x1, and the offset table must fit
+        uint32_t mipCount = 1;
+        for (uint32_t w = header_->width, h = header_->height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) {
+            ++mipCount;
+        }
+        if (header_->levels > mipCount ||
+            sizeof(EnvironmentMapHeader) + uint64_t(header_->levels) * sizeof(uint64_t) > file_.size()) {
+            return false;
+        }
+
+        const uint64_t* offsets = reinterpret_cast<const uint64_t*>(file_.data() + sizeof(EnvironmentMapHeader));
+        int w = int(header_->width), h = int(header_->height);
+        for (uint32_t level = 0; level < header_->levels; ++level) {
+            uint64_t levelBytes = uint64_t(w) * h * 3 * sizeof(float);
+            if (offsets[level] > file_.size() || levelBytes > file_.size() - offsets[level]) {
+                return false;
+            }
+            levelData_.push_back(reinterpret_cast<const float*>(file_.data() + offsets[level]));
+            levelWidth_.push_back(w);
+            levelHeight_.push_back(h);
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+        return true;
+    }
+
+    int width() const { return int(header_->width); }
+    int height() const { return int(header_->height); }
+
+    Color shade(const Vec3& direction, double footprint) const override {
+        double u = (std::atan2(direction.x(), direction.z()) + M_PI) / (2.0 * M_PI);
+        double v = std::acos(std::max(-1.0, std::min(1.0, direction.y()))) / M_PI;
+
+        // Footprint diameter in level-0 texels (rows span pi radians)
+        double texels = 2.0 * footprint * header_->height / M_PI;
+        double level = std::max(0.0, std::min(double(levelData_.size() - 1), std::log2(std::max(texels, 1.0))));
+        int lower = int(level);
+        int upper = std::min(lower + 1, int(levelData_.size()) - 1);
+        double blend = level - lower;
+
+        Color result = bilinear(lower, u, v);
+        if (blend > 0.0 && upper != lower) {
+            result = result * (1.0 - blend) + bilinear(upper, u, v) * blend;
+        }
+        return result;
+    }
+};
+
+// =============================================================================
+// Baked procedural sky
+// =============================================================================
+
+/**
+ * Cubemap cache file: header, then per level the six faces (+X, -X, +Y,
+ * -Y, +Z, -Z) of RGB floats row by row
+ */
+struct CubemapHeader {
+    char magic[4];          // "BHCM"
+    uint32_t version;
+    uint32_t skyVersion;    // Version of the procedural sky that was baked
+    uint32_t faceSize;
+    uint32_t bakeSamples;
+    uint32_t levels;
+};
+
+/**
+ * Direction through face coordinates a, b in [-1, 1]
+ */
+Vec3 cubemapDirection(int face, double a, double b) {
+    switch (face) {
+        case 0: return Vec3(1, -b, -a).normalize();
+        case 1: return Vec3(-1, -b, a).normalize();
+        case 2: return Vec3(a, 1, b).normalize();
+        case 3: return Vec3(a, -1, -b).normalize();
+        case 4: return Vec3(a, -b, 1).normalize();
+        default: return Vec3(-a, -b, -1).normalize();
+    }
+}
+
+/**
+ * Face and face coordinates in [0, 1] of a direction (inverse of cubemapDirection)
+ */
+int cubemapFace(const Vec3& d, double& u, double& v) {
+    double ax = std::abs(d.x()), ay = std::abs(d.y()), az = std::abs(d.z());
+    int face;
+    double sc, tc, ma;
+    if (ax >= ay && ax >= az) {
+        face = d.x() > 0 ? 0 : 1;
+        sc = d.x() > 0 ? -d.z() : d.z();
+        tc = -d.y();
+        ma = ax;
+    } else if (ay >= az) {
+        face = d.y() > 0 ? 2 : 3;
+        sc = d.x();
+        tc = d.y() > 0 ? d.z() : -d.z();
+        ma = ay;
+    } else {
+        face = d.z() > 0 ? 4 : 5;
+        sc = d.z() > 0 ? d.x() : -d.x();
+        tc = -d.y();
+        ma = az;
+    }
+    u = 0.5 * (sc / ma + 1.0);
+    v = 0.5 * (tc / ma + 1.0);
+    return face;
+}
+
+/**
+ * Bake the procedural sky (stars and nebula from shadeBackground) into a
+ * cubemap with a full mip chain and write it to filename. Each texel
+ * averages a small grid of procedural samples; faces and mip levels are
+ * filled in parallel over rows. The file is written under a temporary name
+ * unique to this process and renamed, so concurrent runs never see a
+ * partial cache.
+ */
+bool bakeProceduralCubemap(const std::string& filename, int faceSize, int samples, ThreadPool& pool) {
+    std::vector<std::vector<float>> levels;
+    std::vector<int> sizes;
+
+    levels.emplace_back(size_t(6) * faceSize * faceSize * 3);
+    sizes.push_back(faceSize);
+    parallelFor(pool, 6 * faceSize, [&](int faceRow) {
+        int face = faceRow / faceSize, y = faceRow % faceSize;
+        float* row = levels[0].data() + (size_t(face) * faceSize + y) * faceSize * 3;
+        for (int x = 0; x < faceSize; ++x) {
+            Color sum;
+            for (int sy = 0; sy < samples; ++sy) {
+                for (int sx = 0; sx < samples; ++sx) {
+                    double a = 2.0 * (x + (sx + 0.5) / samples) / faceSize - 1.0;
+                    double b = 2.0 * (y + (sy + 0.5) / samples) / faceSize - 1.0;
+                    sum = sum + shadeBackground(cubemapDirection(face, a, b));
+                }
+            }
+            sum = sum * (1.0 / (samples * samples));
+            row[x * 3] = float(sum.r());
+            row[x * 3 + 1] = float(sum.g());
+            row[x * 3 + 2] = float(sum.b());
+        }
+    });
+
+    while (sizes.back() > 1) {
+        int fine = sizes.back(), coarse = fine / 2;
+        const std::vector<float>& source = levels.back();
+        std::vector<float> target(size_t(6) * coarse * coarse * 3);
+        parallelFor(pool, 6 * coarse, [&](int faceRow) {
+            int face = faceRow / coarse, y = faceRow % coarse;
+            for (int x = 0; x < coarse; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    float sum = 0.0f;
+                    for (int dy = 0; dy < 2; ++dy) {
+                        for (int dx = 0; dx < 2; ++dx) {
+                            sum += source[((size_t(face) * fine + 2 * y + dy) * fine + 2 * x + dx) * 3 + c];
+                        }
+                    }
+                    target[((size_t(face) * coarse + y) * coarse + x) * 3 + c] = 0.25f * sum;
+                }
+            }
+        });
+        levels.push_back(std::move(target));
+        sizes.push_back(coarse);
+    }
+
+    std::string temporary = filename + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        CubemapHeader header = {{'B', 'H', 'C', 'M'}, CubemapConfig::FORMAT_VERSION, CubemapConfig::SKY_VERSION,
+                                uint32_t(faceSize), uint32_t(samples), uint32_t(levels.size())};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& level : levels) {
+            out.write(reinterpret_cast<const char*>(level.data()), std::streamsize(level.size() * sizeof(float)));
+        }
+        if (!out) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Procedural sky served from a baked, memory-mapped cubemap: shading is one
+ * trilinear fetch at the mip level matching the footprint. The cache file
+ * name encodes the bake parameters, so a matching file is simply mapped
+ * and anything else is rebaked.
+ */
+class CubemapSky : public SkyBackground {
+private:
+    MappedFile file_;
+    int faceSize_ = 0;
+    std::vector<const float*> levelData_;   // Six faces per level
+    std::vector<int> levelSize_;
+
+    Color bilinear(int level, int face, double u, double v) const {
+        int n = levelSize_[level];
+        const float* texels = levelData_[level] + size_t(face) * n * n * 3;
+        double fx = u * n - 0.5, fy = v * n - 0.5;
+        int x0 = int(std::floor(fx)), y0 = int(std::floor(fy));
+        double tx = fx - x0, ty = fy - y0;
+
+        Color result;
+        for (int dy = 0; dy < 2; ++dy) {
+            int y = std::min(n - 1, std::max(0, y0 + dy));
+            for (int dx = 0; dx < 2; ++dx) {
+                int x = std::min(n - 1, std::max(0, x0 + dx));
+                double weight = (dx ? tx : 1.0 - tx) * (dy ? ty : 1.0 - ty);
+                const float* texel = texels + (size_t(y) * n + x) * 3;
+                result = result + Color(texel[0], texel[1], texel[2]) * weight;
+            }
+        }
+        return result;
+    }
+
+    bool map(const std::string& filename, int faceSize, int samples) {
+        if (!file_.open(filename) || file_.size() < sizeof(CubemapHeader)) {
+            return false;
+        }
+        const CubemapHeader* header = reinterpret_cast<const CubemapHeader*>(file_.data());
+        if (std::memcmp(header->magic, "BHCM", 4) != 0 || header->version != CubemapConfig::FORMAT_VERSION ||
+            header->skyVersion != CubemapConfig::SKY_VERSION || int(header->faceSize) != faceSize ||
+            int(header->bakeSamples) != samples) {
+            return false;
+        }
+
+        // At least the full-size level and at most the mip chain down to 1x1
+        uint32_t mipCount = 1;
+        for (int size = faceSize; size > 1; size /= 2) {
+            ++mipCount;
+        }
+        if (header->levels == 0 || header->levels > mipCount) {
+            return false;
+        }
+
+        size_t offset = sizeof(CubemapHeader);
+        int n = faceSize;
+        for (uint32_t level = 0; level < header->levels; ++level) {
+            size_t bytes = size_t(6) * n * n * 3 * sizeof(float);
+            if (offset + bytes > file_.size()) {
+                return false;
+            }
+            levelData_.push_back(reinterpret_cast<const float*>(file_.data() + offset));
+            levelSize_.push_back(n);
+            offset += bytes;
+            n /= 2;
+        }
+        faceSize_ = faceSize;
+        return true;
+    }
+
+public:
+    /**
+     * Map the cached bake for these parameters, baking it first if needed
+     */
+    bool open(const std::string& cacheDirectory, int faceSize, ThreadPool& pool) {
+        if (faceSize <= 0 || (faceSize & (faceSize - 1)) != 0) {
+            return false;
+        }
+        int samples = CubemapConfig::BAKE_SAMPLES;
+        std::string filename = cacheDirectory + "/procedural_sky_" + std::to_string(faceSize) + "_s" +
+                               std::to_string(samples) + "_v" + std::to_string(CubemapConfig::SKY_VERSION) + ".bhcm";
+
+        auto start = std::chrono::steady_clock::now();
+        if (map(filename, faceSize, samples)) {
+            std::cout << "Mapped cached sky " << filename << "\n";
+            return true;
+        }
+        levelData_.clear();
+        levelSize_.clear();
+
+        std::cout << "Baking procedural sky (" << faceSize << "^2 x 6 faces)...\n";
+        if (!bakeProceduralCubemap(filename, faceSize, samples, pool) || !map(filename, faceSize, samples)) {
+            return false;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Baked and cached " << filename << " in " << seconds << "s\n";
+        return true;
+    }
+
+    Color shade(const Vec3& direction, double footprint) const override {
+        double u, v;
+        int face = cubemapFace(direction, u, v);
+
+        // Footprint diameter in level-0 texels (a face spans about 2 / faceSize radians per texel)
+        double texels = footprint * faceSize_;
+        double level = std::max(0.0, std::min(double(levelData_.size() - 1), std::log2(std::max(texels, 1.0))));
+        int lower = int(level);
+        int upper = std::min(lower + 1, int(levelData_.size()) - 1);
+        double blend = level - lower;
+
+        Color result = bilinear(lower, face, u, v);
+        if (blend > 0.0 && upper != lower) {
+            result = result * (1.0 - blend) + bilinear(upper, face, u, v) * blend;
+        }
+        return result;
+    }
+};
+
+// =============================================================================
+// Forward-splatted stars
+// =============================================================================
+
+/**
+ * Deep space without stars, for renders whose stars are added separately
+ */
+class EmptySky : public SkyBackground {
+public:
+    Color shade(const Vec3&, double) const override {
+        return Color(0.03, 0.03, 0.08);  // Darker space
+    }
+};
+
+/**
+ * Render catalog stars by mapping each one forward to its lensed images
+ * instead of sampling the sky per ray. Geometry is traced at one sample per
+ * pixel against an empty sky; every image of every star then lands as a
+ * small normalized Gaussian splat carrying flux x magnification, dropped
+ * wherever the pixel's own ray ended on the disk or horizon. The star
+ * cost scales with the catalog, not with pixels times samples.
+ */
+void renderSplattedStars(const Camera& cam, const BlackHole& bh, const CatalogSky& catalog, int w, int h,
+                         const std::string& filename, ThreadPool& pool) {
+    std::cout << "Rendering " << w << "x" << h << " at 1 spp with " << catalog.starCount()
+              << " splatted stars...\n";
+    auto start = std::chrono::steady_clock::now();
+
+    // Geometry and the visibility mask of the sky
+    EmptySky empty;
+    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+    std::vector<unsigned char> skyVisible(size_t(w) * h, 0);
+    parallelFor(pool, h, [&](int y) {
+        for (int x = 0; x < w; ++x) {
+            RayHit hit = traceGeodesic(cam.position(), cam.getRayDirection(x + 0.5, y + 0.5, w, h), bh);
+            image[y][x] = shadeHit(hit, bh, empty, 0.0);
+            skyVisible[size_t(y) * w + x] = hit.type == HitType::Escaped;
+        }
+    });
+    auto traced = std::chrono::steady_clock::now();
+
+    // Every image of every star
+    std::vector<Vec3> directions(size_t(catalog.starCount()));
+    for (size_t i = 0; i < directions.size(); ++i) {
+        const CatalogStar& star = catalog.stars()[i];
+        directions[i] = Vec3(star.x, star.y, star.z);
+    }
+    DeflectionTable table(bh, cam.position().distanceTo(bh.position()), pool);
+    std::vector<LensedImage> images = solveLensedImages(table, bh, cam.position(), directions, pool);
+    auto solved = std::chrono::steady_clock::now();
+
+    // Splat: flux per solid angle of the receiving pixel
+    double scale = std::tan(cam.fieldOfView() * 0.5);
+    double pixelWidth = 2.0 * scale / w, pixelHeight = 2.0 * scale / h;
+    double inverseTwoSigma2 = 1.0 / (2.0 * SplatConfig::SIGMA_PIXELS * SplatConfig::SIGMA_PIXELS);
+    const int radius = SplatConfig::RADIUS_PIXELS;
+    size_t splatted = 0;
+    for (const LensedImage& lensed : images) {
+        double px, py;
+        if (!cam.projectDirection(lensed.direction, w, h, px, py) || px < -radius || py < -radius ||
+            px >= w + radius || py >= h + radius) {
+            continue;
+        }
+
+        int cx = int(std::floor(px)), cy = int(std::floor(py));
+        double weights[2 * SplatConfig::RADIUS_PIXELS + 1][2 * SplatConfig::RADIUS_PIXELS + 1];
+        double weightSum = 0.0;
+        for (int dy = -radius; dy <= radius; ++dy) {
+            for (int dx = -radius; dx <= radius; ++dx) {
+                double ox = cx + dx + 0.5 - px, oy = cy + dy + 0.5 - py;
+                weights[dy + radius][dx + radius] = std::exp(-(ox * ox + oy * oy) * inverseTwoSigma2);
+                weightSum += weights[dy + radius][dx + radius];
+            }
+        }
+
+        const CatalogStar& star = catalog.stars()[lensed.source];
+        double forward = lensed.direction.dot(cam.direction());
+        double pixelSolidAngle = pixelWidth * pixelHeight * forward * forward * forward;
+        Color radiance = Color(star.r, star.g, star.b) * (star.flux * lensed.magnification / pixelSolidAngle / weightSum);
+        for (int dy = -radius; dy <= radius; ++dy) {
+            for (int dx = -radius; dx <= radius; ++dx) {
+                int x = cx + dx, y = cy + dy;
+                if (x >= 0 && y >= 0 && x < w && y < h && skyVisible[size_t(y) * w + x]) {
+                    image[y][x] = image[y][x] + radiance * weights[dy + radius][dx + radius];
+                }
+            }
+        }
+        ++splatted;
+    }
+
+    for (auto& row : image) {
+        for (Color& pixel : row) {
+            pixel = pixel.enhanceContrast().clamp();
+        }
+    }
+
+    auto done = std::chrono::steady_clock::now();
+    std::cout << "Geometry " << std::chrono::duration<double, std::milli>(traced - start).count() << " ms, "
+              << images.size() << " images solved in " << std::chrono::duration<double, std::milli>(solved - traced).count()
+              << " ms, " << splatted << " splatted in " << std::chrono::duration<double, std::milli>(done - solved).count()
+              << " ms\n";
+    writePPM(filename, image);
+}
+
+// =============================================================================
+// Volumetric thick disk
+// =============================================================================
+
+/**
+ * Geometrically thick, optically semi-transparent accretion flow around a
+ * BlackHole: Gaussian in height with scale height aspect * R, midplane
+ * density falling as R^-DENSITY_SLOPE between the hole's disk radii, and
+ * emitting with the thin disk's color at each radius.
+ *
+ * The density is bounded by an analytic wedge (|y| below BOUND_SIGMAS
+ * scale heights and R inside the outer edge plus the same margin), so
+ * segments outside it are skipped with a single distance check and only
+ * segments crossing the flow are sampled.
+ */
+class ThickDisk {
+private:
+    const BlackHole& bh_;
+    double aspect_;
+    double opacity_;
+    double slope_;          // Half-opening slope of the bounding wedge
+    double boundRadius_;    // Cylindrical radius beyond which the density is treated as zero
+
+public:
+    ThickDisk(const BlackHole& bh, double aspect, double opacity)
+        : bh_(bh), aspect_(aspect), opacity_(opacity) {
+        slope_ = ThickDiskConfig::BOUND_SIGMAS * aspect_;
+        boundRadius_ = bh_.diskOuterRadius() * (1.0 + slope_);
+    }
+
+    /**
+     * Lower bound on the distance from p to any point with non-zero density
+     */
+    double emptyDistance(const Vec3& p) const {
+        Vec3 d = p - bh_.position();
+        double radius = std::sqrt(d.x() * d.x() + d.z() * d.z());
+        double aboveWedge = (std::abs(d.y()) - slope_ * radius) / std::sqrt(1.0 + slope_ * slope_);
+        return std::max(0.0, std::max(radius - boundRadius_, aboveWedge));
+    }
+
+    /**
+     * Density at p (unit density at the inner edge midplane)
+     */
+    double density(const Vec3& p) const {
+        Vec3 d = p - bh_.position();
+        double radius = std::sqrt(d.x() * d.x() + d.z() * d.z());
+        double inner = bh_.diskInnerRadius(), outer = bh_.diskOuterRadius();
+        double height = aspect_ * std::max(radius, inner);
+        double rho = std::pow(std::max(radius, inner) / inner, -ThickDiskConfig::DENSITY_SLOPE) *
+                     std::exp(-0.5 * d.y() * d.y() / (height * height));
+        if (radius < inner) {
+            rho *= std::exp(-(inner - radius) / (ThickDiskConfig::INNER_TAPER * bh_.mass()));
+        } else if (radius > outer) {
+            rho *= std::exp(-(radius - outer) / height);
+        }
+        return rho;
+    }
+
+    /**
+     * Accumulated state of one ray crossing the volume. Marcher steps are
+     * usually shorter than the sample spacing, so path length is pooled in
+     * pending and sampled once per spacing at the latest segment midpoint.
+     */
+    struct Ray {
+        Color emission;
+        double transmittance = 1.0;
+        double pending = 0.0;
+        Vec3 pendingPoint;
+    };
+
+    /**
+     * Add one straight segment to the ray. Returns false once the ray is
+     * effectively opaque so the march can stop.
+     */
+    bool integrate(const Vec3& start, const Vec3& direction, double length, Ray& ray) const {
+        if (emptyDistance(start) > length) {
+            return flush(ray);
+        }
+
+        Vec3 mid = start + direction * (0.5 * length);
+        Vec3 offset = mid - bh_.position();
+        double radius = std::max(std::sqrt(offset.x() * offset.x() + offset.z() * offset.z()), bh_.diskInnerRadius());
+        double spacing = aspect_ * radius / ThickDiskConfig::SAMPLES_PER_SCALE_HEIGHT;
+
+        if (length <= spacing) {
+            ray.pending += length;
+            ray.pendingPoint = mid;
+            return ray.pending < spacing || flush(ray);
+        }
+
+        int samples = int(std::ceil(length / spacing));
+        double ds = length / samples;
+        for (int i = 0; i < samples; ++i) {
+            if (!sample(start + direction * ((i + 0.5) * ds), ds, ray)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Sample any pooled path length
+     */
+    bool flush(Ray& ray) const {
+        if (ray.pending <= 0.0) {
+            return true;
+        }
+        double ds = ray.pending;
+        ray.pending = 0.0;
+        return sample(ray.pendingPoint, ds, ray);
+    }
+
+private:
+    bool sample(const Vec3& p, double ds, Ray& ray) const {
+        double rho = density(p);
+        if (rho < 1e-6) {
+            return true;
+        }
+        double attenuation = std::exp(-opacity_ * rho * ds);
+        Vec3 inPlane(p.x(), bh_.position().y(), p.z());
+        Color source = bh_.calculateAccretionDiskColor(inPlane) * ThickDiskConfig::EMISSIVITY;
+        ray.emission = ray.emission + source * (ray.transmittance * (1.0 - attenuation));
+        ray.transmittance *= attenuation;
+        return ray.transmittance >= ThickDiskConfig::EARLY_TERMINATION;
+    }
+};
+
+/**
+ * March a ray through a thick disk; the thin disk plane is transparent.
+ * Emission and transmittance are recorded on the returned hit.
+ */
+RayHit traceThickDisk(const Vec3& origin, const Vec3& direction, const BlackHole& bh, const ThickDisk& disk) {
+    ThickDisk::Ray ray;
+    RayHit hit = marchGeodesic(origin, direction, bh, [](const RayHit&) { return false; },
+                               [&](const Vec3& start, const Vec3& segment, double length) {
+                                   return disk.integrate(start, segment, length, ray);
+                               });
+    disk.flush(ray);
+    hit.emission = ray.emission;
+    hit.transmittance = ray.transmittance < ThickDiskConfig::EARLY_TERMINATION ? 0.0 : ray.transmittance;
+    return hit;
+}
+
+// =============================================================================
+// Out-of-core simulation volumes
+// =============================================================================
+
+/**
+ * Bricked volume file: header, per-brick peak density (occupancy), per-brick
+ * byte offsets (padded to start 8-byte aligned), then page-aligned bricks in
+ * Morton order. Each brick holds
+ * (brickSize + 1)^3 voxels (the extra layer duplicates the neighbour's
+ * first voxels so trilinear lookups never straddle bricks) as per-voxel
+ * interleaved uint16 channels, quantized per brick and channel; density and
+ * temperature are quantized in log space.
+ */
+struct VolumeHeader {
+    char magic[4];          // "BHGV"
+    uint32_t version;
+    uint32_t dims[3];       // Voxels along x, y, z
+    uint32_t brickSize;
+    uint32_t bricks[3];     // Bricks along x, y, z
+    uint32_t channels;
+    float extent;           // Grid spans [-extent, extent]^3 around the hole (in M)
+    uint32_t reserved;
+};
+
+/**
+ * File offset of the per-brick offset table, just past the peak densities
+ */
+inline size_t volumeOffsetTableStart(size_t brickCount) {
+    return (sizeof(VolumeHeader) + brickCount * sizeof(float) + alignof(uint64_t) - 1) / alignof(uint64_t) *
+           alignof(uint64_t);
+}
+
+struct BrickQuantization {
+    float offset[GrmhdConfig::CHANNELS];
+    float scale[GrmhdConfig::CHANNELS];
+};
+
+/**
+ * Channel as stored: log for the positive fields, linear for velocity
+ */
+inline float encodeChannel(int channel, float value) {
+    return channel < 2 ? std::log(std::max(value, 1e-30f)) : value;
+}
+
+inline float decodeChannel(int channel, float value) {
+    return channel < 2 ? std::exp(value) : value;
+}
+
+/**
+ * Convert a raw snapshot (nx * ny * nz records of five float32 channels:
+ * density, temperature in the disk palette's units, and velocity in units of
+ * c, x fastest then y then z) into a bricked volume. The input is streamed
+ * one row of bricks at a time, so memory stays at a few brick rows however
+ * large the snapshot is.
+ */
+bool convertVolume(const std::string& input, const std::string& output, const uint32_t dims[3], double extent,
+                   int brickSize, ThreadPool& pool) {
+    const int channels = GrmhdConfig::CHANNELS;
+    std::ifstream in(input, std::ios::binary);
+    if (!in || brickSize < 2) {
+        return false;
+    }
+
+    VolumeHeader header = {};
+    std::memcpy(header.magic, "BHGV", 4);
+    header.version = GrmhdConfig::FORMAT_VERSION;
+    header.brickSize = uint32_t(brickSize);
+    header.channels = channels;
+    header.extent = float(extent);
+    size_t brickCount = 1;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.dims[axis] = dims[axis];
+        header.bricks[axis] = (dims[axis] + brickSize - 1) / brickSize;
+        brickCount *= header.bricks[axis];
+    }
+
+    // Bricks are stored in Morton order of their coordinates
+    auto linearIndex = [&](uint32_t bx, uint32_t by, uint32_t bz) {
+        return (size_t(bz) * header.bricks[1] + by) * header.bricks[0] + bx;
+    };
+    std::vector<size_t> order(brickCount);
+    for (size_t i = 0; i < brickCount; ++i) {
+        order[i] = i;
+    }
+    auto codeOf = [&](size_t i) {
+        return mortonCode(uint32_t(i % header.bricks[0]), uint32_t(i / header.bricks[0] % header.bricks[1]),
+                          uint32_t(i / (size_t(header.bricks[0]) * header.bricks[1])));
+    };
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return codeOf(a) < codeOf(b); });
+
+    size_t apron = size_t(brickSize) + 1;
+    size_t voxelsPerBrick = apron * apron * apron;
+    size_t brickBytes = sizeof(BrickQuantization) + voxelsPerBrick * channels * sizeof(uint16_t);
+    size_t tableBytes = volumeOffsetTableStart(brickCount) + brickCount * sizeof(uint64_t);
+    size_t dataStart = (tableBytes + GrmhdConfig::PAGE_ALIGNMENT - 1) / GrmhdConfig::PAGE_ALIGNMENT *
+                       GrmhdConfig::PAGE_ALIGNMENT;
+    std::vector<float> peakDensity(brickCount, 0.0f);
+    std::vector<uint64_t> offsets(brickCount);
+    for (size_t rank = 0; rank < brickCount; ++rank) {
+        offsets[order[rank]] = dataStart + rank * brickBytes;
+    }
+
+    std::ofstream out(output, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+
+    // One row of bricks (fixed by, bz) needs apron x apron input rows
+    size_t rowFloats = size_t(dims[0]) * channels;
+    std::vector<float> rows(apron * apron * rowFloats);
+    std::vector<std::vector<unsigned char>> encoded(header.bricks[0], std::vector<unsigned char>(brickBytes));
+
+    for (uint32_t bz = 0; bz < header.bricks[2]; ++bz) {
+        for (uint32_t by = 0; by < header.bricks[1]; ++by) {
+            for (size_t dz = 0; dz < apron; ++dz) {
+                size_t z = std::min<size_t>(dims[2] - 1, size_t(bz) * brickSize + dz);
+                for (size_t dy = 0; dy < apron; ++dy) {
+                    size_t y = std::min<size_t>(dims[1] - 1, size_t(by) * brickSize + dy);
+                    in.seekg(std::streamoff((z * dims[1] + y) * rowFloats * sizeof(float)));
+                    in.read(reinterpret_cast<char*>(&rows[(dz * apron + dy) * rowFloats]),
+                            std::streamsize(rowFloats * sizeof(float)));
+                }
+            }
+            if (!in) {
+                return false;
+            }
+
+            parallelFor(pool, int(header.bricks[0]), [&](int bx) {
+                auto voxel = [&](size_t dx, size_t dy, size_t dz) {
+                    size_t x = std::min<size_t>(dims[0] - 1, size_t(bx) * brickSize + dx);
+                    return &rows[(dz * apron + dy) * rowFloats + x * channels];
+                };
+
+                BrickQuantization quantization;
+                float peak = 0.0f;
+                for (int c = 0; c < channels; ++c) {
+                    float low = 1e30f, high = -1e30f;
+                    for (size_t dz = 0; dz < apron; ++dz) {
+                        for (size_t dy = 0; dy < apron; ++dy) {
+                            for (size_t dx = 0; dx < apron; ++dx) {
+                                float value = voxel(dx, dy, dz)[c];
+                                if (c == 0) {
+                                    peak = std::max(peak, value);
+                                }
+                                value = encodeChannel(c, value);
+                                low = std::min(low, value);
+                                high = std::max(high, value);
+                            }
+                        }
+                    }
+                    quantization.offset[c] = low;
+                    quantization.scale[c] = high > low ? (high - low) / 65535.0f : 0.0f;
+                }
+
+                unsigned char* target = encoded[bx].data();
+                std::memcpy(target, &quantization, sizeof(quantization));
+                uint16_t* packed = reinterpret_cast<uint16_t*>(target + sizeof(quantization));
+                for (size_t dz = 0; dz < apron; ++dz) {
+                    for (size_t dy = 0; dy < apron; ++dy) {
+                        for (size_t dx = 0; dx < apron; ++dx) {
+                            const float* source = voxel(dx, dy, dz);
+                            for (int c = 0; c < channels; ++c) {
+                                float scale = quantization.scale[c];
+                                float q = scale > 0.0f ? (encodeChannel(c, source[c]) - quantization.offset[c]) / scale
+                                                       : 0.0f;
+                                *packed++ = uint16_t(std::min(65535.0f, std::max(0.0f, q + 0.5f)));
+                            }
+                        }
+                    }
+                }
+                peakDensity[linearIndex(uint32_t(bx), by, bz)] = peak;
+            });
+
+            for (uint32_t bx = 0; bx < header.bricks[0]; ++bx) {
+                out.seekp(std::streamoff(offsets[linearIndex(bx, by, bz)]));
+                out.write(reinterpret_cast<const char*>(encoded[bx].data()), std::streamsize(brickBytes));
+            }
+        }
+        std::cout << "\rConverted brick layer " << (bz + 1) << "/" << header.bricks[2] << std::flush;
+    }
+    std::cout << "\n";
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(peakDensity.data()), std::streamsize(brickCount * sizeof(float)));
+    out.seekp(std::streamoff(volumeOffsetTableStart(brickCount)));
+    out.write(reinterpret_cast<const char*>(offsets.data()), std::streamsize(brickCount * sizeof(uint64_t)));
+    return bool(out);
+}
+
+/**
+ * Memory-mapped bricked volume. Bricks are decoded on demand into an LRU
+ * cache bounded by a byte budget and shared by all threads; the cache is
+ * split into shards with their own locks so concurrent lookups of
+ * different bricks rarely contend, and decoding happens outside the lock.
+ * Untouched parts of the file are never paged in, so snapshots far larger
+ * than RAM render in the memory the touched bricks need.
+ */
+class BrickedVolume {
+public:
+    using Brick = std::shared_ptr<const std::vector<float>>;
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::pair<size_t, Brick>> recent;     // Most recently used first
+        std::unordered_map<size_t, std::list<std::pair<size_t, Brick>>::iterator> index;
+    };
+
+    MappedFile file_;
+    const VolumeHeader* header_ = nullptr;
+    const float* peakDensity_ = nullptr;
+    const uint64_t* offsets_ = nullptr;
+    size_t brickCount_ = 0;
+    size_t apron_ = 0;
+    double voxelSize_ = 0.0;
+    size_t shardCapacity_ = 0;      // Bricks per shard
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<uint64_t> hits_{0}, misses_{0};
+
+    Brick decode(size_t brick) const {
+        const unsigned char* source = file_.data() + offsets_[brick];
+        BrickQuantization quantization;
+        std::memcpy(&quantization, source, sizeof(quantization));
+        const uint16_t* packed = reinterpret_cast<const uint16_t*>(source + sizeof(quantization));
+
+        size_t values = apron_ * apron_ * apron_ * GrmhdConfig::CHANNELS;
+        auto voxels = std::make_shared<std::vector<float>>(values);
+        for (size_t i = 0; i < values; ++i) {
+            int c = int(i % GrmhdConfig::CHANNELS);
+            (*voxels)[i] = decodeChannel(c, quantization.offset[c] + quantization.scale[c] * packed[i]);
+        }
+        return voxels;
+    }
+
+public:
+    bool open(const std::string& filename, size_t cacheBytes) {
+        if (!file_.open(filename) || file_.size() < sizeof(VolumeHeader)) {
+            return false;
+        }
+        header_ = reinterpret_cast<const VolumeHeader*>(file_.data());
+        if (std::memcmp(header_->magic, "BHGV", 4) != 0 || header_->version != GrmhdConfig::FORMAT_VERSION ||
+            header_->channels != uint32_t(GrmhdConfig::CHANNELS) || header_->brickSize < 2 ||
+            header_->brickSize > GrmhdConfig::MAX_BRICK_SIZE || !(header_->extent > 0.0f) ||
+            !std::isfinite(header_->extent)) {
+            return false;
+        }
+
+        // Brick grid must tile the voxel grid, and its tables must fit the file
+        double tableBricks = 1.0;
+        for (int axis = 0; axis < 3; ++axis) {
+            uint32_t dims = header_->dims[axis];
+            if (dims == 0 || header_->bricks[axis] != (uint64_t(dims) + header_->brickSize - 1) / header_->brickSize) {
+                return false;
+            }
+            tableBricks *= header_->bricks[axis];
+        }
+        double tableBytes = tableBricks * (sizeof(float) + sizeof(uint64_t)) + sizeof(float);  // Padding is under a float
+        if (tableBytes > double(file_.size() - sizeof(VolumeHeader))) {
+            return false;
+        }
+        brickCount_ = size_t(header_->bricks[0]) * header_->bricks[1] * header_->bricks[2];
+        peakDensity_ = reinterpret_cast<const float*>(file_.data() + sizeof(VolumeHeader));
+        offsets_ = reinterpret_cast<const uint64_t*>(file_.data() + volumeOffsetTableStart(brickCount_));
+        apron_ = header_->brickSize + 1;
+
+        // Every packed brick (quantization, then uint16 voxels) inside the file
+        size_t packedBytes = sizeof(BrickQuantization) + apron_ * apron_ * apron_ * GrmhdConfig::CHANNELS * sizeof(uint16_t);
+        for (size_t brick = 0; brick < brickCount_; ++brick) {
+            if (offsets_[brick] > file_.size() || packedBytes > file_.size() - offsets_[brick]) {
+                return false;
+            }
+        }
+        voxelSize_ = 2.0 * header_->extent / std::max({header_->dims[0], header_->dims[1], header_->dims[2]});
+
+        size_t brickBytes = apron_ * apron_ * apron_ * GrmhdConfig::CHANNELS * sizeof(float);
+        shardCapacity_ = std::max<size_t>(1, cacheBytes / brickBytes / GrmhdConfig::CACHE_SHARDS);
+        shards_.reset(new Shard[GrmhdConfig::CACHE_SHARDS]);
+        return true;
+    }
+
+    const VolumeHeader& header() const { return *header_; }
+    double voxelSize() const { return voxelSize_; }
+    uint64_t cacheHits() const { return hits_; }
+    uint64_t cacheMisses() const { return misses_; }
+
+    /**
+     * Decoded voxels of a brick, loading and caching it on a miss
+     */
+    Brick acquire(size_t brick) {
+        Shard& shard = shards_[brick % GrmhdConfig::CACHE_SHARDS];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(brick);
+            if (it != shard.index.end()) {
+                shard.recent.splice(shard.recent.begin(), shard.recent, it->second);
+                ++hits_;
+                return it->second->second;
+            }
+        }
+
+        Brick decoded = decode(brick);
+        ++misses_;
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(brick);
+        if (it != shard.index.end()) {
+            return it->second->second;  // Another thread decoded it meanwhile
+        }
+        shard.recent.emplace_front(brick, decoded);
+        shard.index[brick] = shard.recent.begin();
+        if (shard.recent.size() > shardCapacity_) {
+            shard.index.erase(shard.recent.back().first);
+            shard.recent.pop_back();
+        }
+        return decoded;
+    }
+
+    /**
+     * Per-ray lookup state: the brick last sampled stays pinned, so
+     * consecutive samples inside it skip the cache entirely
+     */
+    struct Cursor {
+        size_t brick = SIZE_MAX;
+        Brick voxels;
+    };
+
+    /**
+     * Trilinearly interpolated channels at p (relative to the hole);
+     * false outside the grid or in a brick with no material
+     */
+    bool sample(const Vec3& p, Cursor& cursor, float values[GrmhdConfig::CHANNELS]) {
+        const VolumeHeader& header = *header_;
+        double extent = header.extent;
+        double g[3] = {(p.x() + extent) / voxelSize_ - 0.5, (p.y() + extent) / voxelSize_ - 0.5,
+                       (p.z() + extent) / voxelSize_ - 0.5};
+        size_t brickCoord[3];
+        double local[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            if (g[axis] < 0.0 || g[axis] > header.dims[axis] - 1.0) {
+                return false;
+            }
+            brickCoord[axis] = std::min<size_t>(header.bricks[axis] - 1, size_t(g[axis]) / header.brickSize);
+            local[axis] = g[axis] - double(brickCoord[axis] * header.brickSize);
+        }
+
+        size_t brick = (brickCoord[2] * header.bricks[1] + brickCoord[1]) * header.bricks[0] + brickCoord[0];
+        if (peakDensity_[brick] < GrmhdConfig::EMPTY_DENSITY) {
+            return false;
+        }
+        if (brick != cursor.brick) {
+            cursor.voxels = acquire(brick);
+            cursor.brick = brick;
+        }
+
+        size_t x0 = std::min(size_t(local[0]), apron_ - 2);
+        size_t y0 = std::min(size_t(local[1]), apron_ - 2);
+        size_t z0 = std::min(size_t(local[2]), apron_ - 2);
+        double tx = local[0] - x0, ty = local[1] - y0, tz = local[2] - z0;
+        const float* voxels = cursor.voxels->data();
+        for (int c = 0; c < GrmhdConfig::CHANNELS; ++c) {
+            values[c] = 0.0f;
+        }
+        for (int corner = 0; corner < 8; ++corner) {
+            size_t dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+            double weight = (dx ? tx : 1.0 - tx) * (dy ? ty : 1.0 - ty) * (dz ? tz : 1.0 - tz);
+            const float* voxel = voxels + (((z0 + dz) * apron_ + (y0 + dy)) * apron_ + (x0 + dx)) * GrmhdConfig::CHANNELS;
+            for (int c = 0; c < GrmhdConfig::CHANNELS; ++c) {
+                values[c] += float(weight) * voxel[c];
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * March a ray through a simulation volume; the thin disk plane is
+ * transparent. Samples are spaced one voxel apart; each adds emission with
+ * the disk palette at the local temperature, Doppler beamed by the local
+ * velocity, and absorbs in proportion to density.
+ */
+RayHit traceVolume(const Vec3& origin, const Vec3& direction, const BlackHole& bh, BrickedVolume& volume,
+                   double opacity) {
+    BrickedVolume::Cursor cursor;
+    Color emission;
+    double transmittance = 1.0;
+    double pending = 0.0;
+    double spacing = volume.voxelSize();
+    double extent = volume.header().extent;
+
+    RayHit hit = marchGeodesic(origin, direction, bh, [](const RayHit&) { return false; },
+                               [&](const Vec3& start, const Vec3& segment, double length) {
+        Vec3 local = start - bh.position();
+        if (std::abs(local.x()) > extent + length || std::abs(local.y()) > extent + length ||
+            std::abs(local.z()) > extent + length) {
+            pending = 0.0;
+            return true;  // Outside the grid's box
+        }
+        pending += length;
+        while (pending >= spacing) {
+            pending -= spacing;
+            Vec3 p = local + segment * (length - pending);
+            float values[GrmhdConfig::CHANNELS];
+            if (!volume.sample(p, cursor, values) || values[0] < GrmhdConfig::EMPTY_DENSITY) {
+                continue;
+            }
+
+            Vec3 velocity(values[2], values[3], values[4]);
+            double beta2 = std::min(0.99, velocity.lengthSquared());
+            double doppler = std::sqrt(1.0 - beta2) / (1.0 + velocity.dot(segment));  // Toward the camera is -segment
+            double attenuation = std::exp(-opacity * values[0] * spacing);
+            Color source = BlackHole::temperatureColor(values[1]) *
+                           (values[1] * GrmhdConfig::EMISSIVITY * std::pow(doppler, KerrConfig::BEAMING_EXPONENT));
+            emission = emission + source * (transmittance * (1.0 - attenuation));
+            transmittance *= attenuation;
+            if (transmittance < GrmhdConfig::EARLY_TERMINATION) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    hit.emission = emission;
+    hit.transmittance = transmittance < GrmhdConfig::EARLY_TERMINATION ? 0.0 : transmittance;
+    return hit;
+}
+
+// =============================================================================
+// Kerr black hole
+// =============================================================================
+
+/**
+ * Rotating black hole sharing a BlackHole's position, mass and disk, with
+ * its spin along +Y so the disk stays in the hole's equatorial plane.
+ *
+ * Photons are integrated in Boyer-Lindquist coordinates. The conserved
+ * energy, axial angular momentum and Carter constant separate the geodesic
+ * into independent radial and polar equations in Mino time, so each step
+ * only evaluates the two potentials R(r) and Theta(theta) and their
+ * derivatives. The radial and polar velocities are stepped through
+ * dr'/dl = R'/2 and dtheta'/dl = Theta'/2, which carry them smoothly
+ * through turning points where the square-root forms change sign, and are
+ * re-projected onto the first-order constraints away from them so errors
+ * cannot accumulate into false turning points.
+ */
+class KerrBlackHole {
+private:
+    const BlackHole& bh_;
+    double mass_;
+    double a_;              // Spin parameter a = J / M (length units)
+    double horizon_;        // Outer horizon r+
+    double isco_;           // Prograde innermost stable circular orbit
+
+    struct State {
+        double r, theta, phi;
+        double vr, vtheta;  // dr/dl, dtheta/dl in Mino time
+        double time;        // Boyer-Lindquist time along the ray (negative: traced backwards)
+    };
+
+    // Boyer-Lindquist axes in the scene: X' = z, Y' = x, Z' = y (spin axis)
+    Vec3 toLocal(const Vec3& v) const { return Vec3(v.z(), v.x(), v.y()); }
+    Vec3 toScene(const Vec3& v) const { return Vec3(v.y(), v.z(), v.x()); }
+
+    Vec3 cartesian(double r, double theta, double phi) const {
+        double rho = std::sqrt(r * r + a_ * a_);
+        return Vec3(rho * std::sin(theta) * std::cos(phi), rho * std::sin(theta) * std::sin(phi), r * std::cos(theta));
+    }
+
+    /**
+     * Mino-time derivatives for impact parameter lambda = L/E and eta = Q/E^2
+     */
+    State derivative(const State& s, double lambda, double eta) const {
+        double r2 = s.r * s.r;
+        double delta = r2 - 2.0 * mass_ * s.r + a_ * a_;
+        double p = r2 + a_ * a_ - a_ * lambda;
+        double k = eta + (lambda - a_) * (lambda - a_);
+        double cosT = std::cos(s.theta);
+        double sinT = std::sin(s.theta);
+        sinT = std::copysign(std::max(std::abs(sinT), 1e-6), sinT);
+        double sin2 = sinT * sinT;
+
+        State d;
+        d.r = s.vr;
+        d.theta = s.vtheta;
+        d.phi = a_ * p / delta - a_ + lambda / sin2;
+        d.vr = 2.0 * s.r * p - (s.r - mass_) * k;                                             // R'(r) / 2
+        d.vtheta = -a_ * a_ * cosT * sinT + lambda * lambda * cosT / (sinT * sin2);            // Theta'(theta) / 2
+        d.time = (r2 + a_ * a_) * p / delta - a_ * (a_ * sin2 - lambda);
+        return d;
+    }
+
+    /**
+     * Pull the velocities back onto the first-order constraints
+     * (dr/dl)^2 = R(r) and (dtheta/dl)^2 = Theta(theta), keeping their signs.
+     * Skipped near turning points, where the second-order form has to flip them.
+     */
+    void project(State& s, double lambda, double eta) const {
+        double r2a2 = s.r * s.r + a_ * a_;
+        double delta = s.r * s.r - 2.0 * mass_ * s.r + a_ * a_;
+        double p = r2a2 - a_ * lambda;
+        double radial = p * p - delta * (eta + (lambda - a_) * (lambda - a_));
+        if (radial > KerrConfig::PROJECTION_THRESHOLD * r2a2 * r2a2) {
+            s.vr = std::copysign(std::sqrt(radial), s.vr);
+        }
+
+        double cosT = std::cos(s.theta), sinT = std::sin(s.theta);
+        double polar = eta + a_ * a_ * cosT * cosT - (sinT != 0.0 ? lambda * lambda * cosT * cosT / (sinT * sinT) : 0.0);
+        if (polar > KerrConfig::PROJECTION_THRESHOLD * (std::abs(eta) + a_ * a_)) {
+            s.vtheta = std::copysign(std::sqrt(polar), s.vtheta);
+        }
+    }
+
+    static State advance(const State& s, const State& d, double h) {
+        return {s.r + d.r * h, s.theta + d.theta * h, s.phi + d.phi * h, s.vr + d.vr * h, s.vtheta + d.vtheta * h,
+                s.time + d.time * h};
+    }
+
+    /**
+     * Photon energy ratio (observed at the camera over emitted) for a disk
+     * hit at radius r, the gas on prograde Keplerian orbits
+     */
+    double diskRedshift(double r, double lambda, double energy) const {
+        double sqrtM = std::sqrt(mass_);
+        double r32 = r * std::sqrt(r);
+        double omega = sqrtM / (r32 + a_ * sqrtM);
+        double denominator = r32 - 3.0 * mass_ * std::sqrt(r) + 2.0 * a_ * sqrtM;
+        if (denominator <= 0.0) {
+            return 1.0;
+        }
+        double ut = (r32 + a_ * sqrtM) / (std::pow(r, 0.75) * std::sqrt(denominator));
+        return 1.0 / (energy * ut * (1.0 - omega * lambda));
+    }
+
+public:
+    KerrBlackHole(const BlackHole& bh, double spin)
+        : bh_(bh), mass_(bh.mass()) {
+        spin = std::max(-0.999, std::min(0.999, spin));
+        a_ = spin * mass_;
+        horizon_ = mass_ + std::sqrt(mass_ * mass_ - a_ * a_);
+
+        // Bardeen-Press-Teukolsky prograde ISCO
+        double z1 = 1.0 + std::cbrt(1.0 - spin * spin) * (std::cbrt(1.0 + spin) + std::cbrt(1.0 - spin));
+        double z2 = std::sqrt(3.0 * spin * spin + z1 * z1);
+        double sign = spin >= 0.0 ? 1.0 : -1.0;
+        isco_ = mass_ * (3.0 + z2 - sign * std::sqrt((3.0 - z1) * (3.0 + z1 + 2.0 * z2)));
+    }
+
+    double spin() const { return a_ / mass_; }
+    double horizonRadius() const { return horizon_; }
+    double iscoRadius() const { return isco_; }
+
+    /**
+     * Trace a photon from a camera at rest in the zero-angular-momentum
+     * frame, its local axes aligned with the coordinate directions. The
+     * conserved quantities are those of the photon the camera receives,
+     * which arrives travelling along -direction, and its geodesic is
+     * integrated backwards in Mino time from the camera to the source (the
+     * Kerr metric is not symmetric under t -> -t alone, so tracing a
+     * future-directed photon out along +direction would see the hole spin
+     * the other way). Disk hits span the ISCO to the BlackHole's outer disk
+     * radius and carry the disk gas redshift; pathLength is the coordinate
+     * time from the disk to the camera.
+     */
+    RayHit trace(const Vec3& origin, const Vec3& direction) const {
+        RayHit hit;
+        Vec3 position = toLocal(origin - bh_.position());
+        Vec3 n = toLocal(direction.normalize());
+
+        // Oblate spheroidal (Boyer-Lindquist) coordinates of the camera
+        double R2 = position.lengthSquared();
+        double b = R2 - a_ * a_;
+        double r = std::sqrt(0.5 * (b + std::sqrt(b * b + 4.0 * a_ * a_ * position.z() * position.z())));
+        double theta = std::acos(std::max(-1.0, std::min(1.0, position.z() / r)));
+        double phi = std::atan2(position.y(), position.x());
+        if (r < horizon_ * KerrConfig::HORIZON_MARGIN) {
+            hit.type = HitType::Horizon;
+            return hit;
+        }
+
+        // Orthonormal local frame along the coordinate directions
+        double rho = std::sqrt(r * r + a_ * a_);
+        double sinT = std::max(std::sin(theta), 1e-9), cosT = std::cos(theta);
+        double sinP = std::sin(phi), cosP = std::cos(phi);
+        Vec3 eR = Vec3(r / rho * sinT * cosP, r / rho * sinT * sinP, cosT).normalize();
+        Vec3 eTheta = Vec3(rho * cosT * cosP, rho * cosT * sinP, -r * sinT);
+        eTheta = (eTheta - eR * eTheta.dot(eR)).normalize();
+        Vec3 ePhi = eR.cross(eTheta);
+        // Local direction of travel of the received photon
+        double nr = -n.dot(eR), nTheta = -n.dot(eTheta), nPhi = -n.dot(ePhi);
+
+        // Conserved quantities for unit local energy
+        double sigma = r * r + a_ * a_ * cosT * cosT;
+        double delta = r * r - 2.0 * mass_ * r + a_ * a_;
+        double bigA = (r * r + a_ * a_) * (r * r + a_ * a_) - a_ * a_ * delta * sinT * sinT;
+        double angularMomentum = nPhi * std::sqrt(bigA / sigma) * sinT;
+        double energy = std::sqrt(delta * sigma / bigA) + 2.0 * mass_ * a_ * r / bigA * angularMomentum;
+        double lambda = angularMomentum / energy;
+        if (std::abs(lambda) < KerrConfig::POLAR_LAMBDA * mass_) {
+            lambda = 0.0;  // Pole-crossing rays: keeps the lambda^2 cot^2 barrier from going stiff
+        }
+        double pTheta = nTheta * std::sqrt(sigma) / energy;
+        double eta = pTheta * pTheta + cosT * cosT * (lambda * lambda / (sinT * sinT) - a_ * a_);
+
+        State state = {r, theta, phi, nr * std::sqrt(sigma * delta) / energy, pTheta, 0.0};
+        double outerDisk = bh_.diskOuterRadius();
+        double escape = std::max(KerrConfig::ESCAPE_RADIUS * mass_, 2.0 * r);
+        Vec3 previous = cartesian(state.r, state.theta, state.phi);
+
+        for (int step = 0; step < KerrConfig::MAX_STEPS; ++step) {
+            // Step so the coordinate displacement stays a small fraction of r (larger in the weak far field)
+            State d = derivative(state, lambda, eta);
+            double sinNow = std::sin(state.theta);
+            double speed = std::sqrt(d.r * d.r + state.r * state.r * (d.theta * d.theta + sinNow * sinNow * d.phi * d.phi));
+            double fraction = std::min(KerrConfig::MAX_STEP_FRACTION,
+                                       KerrConfig::STEP_FRACTION * std::max(1.0, state.r / (KerrConfig::FAR_FIELD_RADIUS * mass_)));
+            double h = -std::min(fraction * state.r / std::max(speed, 1e-12),
+                                 KerrConfig::MAX_ANGLE_STEP / std::max(std::abs(d.theta) + std::abs(d.phi), 1e-12));
+
+            State k2 = derivative(advance(state, d, 0.5 * h), lambda, eta);
+            State k3 = derivative(advance(state, k2, 0.5 * h), lambda, eta);
+            State k4 = derivative(advance(state, k3, h), lambda, eta);
+            State next;
+            next.r = state.r + h / 6.0 * (d.r + 2.0 * k2.r + 2.0 * k3.r + k4.r);
+            next.theta = state.theta + h / 6.0 * (d.theta + 2.0 * k2.theta + 2.0 * k3.theta + k4.theta);
+            next.phi = state.phi + h / 6.0 * (d.phi + 2.0 * k2.phi + 2.0 * k3.phi + k4.phi);
+            next.vr = state.vr + h / 6.0 * (d.vr + 2.0 * k2.vr + 2.0 * k3.vr + k4.vr);
+            next.vtheta = state.vtheta + h / 6.0 * (d.vtheta + 2.0 * k2.vtheta + 2.0 * k3.vtheta + k4.vtheta);
+            next.time = state.time + h / 6.0 * (d.time + 2.0 * k2.time + 2.0 * k3.time + k4.time);
+            project(next, lambda, eta);
+
+            // Equatorial crossing: interpolate to the plane and test the disk radii
+            double before = state.theta - M_PI / 2.0, after = next.theta - M_PI / 2.0;
+            if ((before < 0.0) != (after < 0.0)) {
+                double t = before / (before - after);
+                double crossR = state.r + (next.r - state.r) * t;
+                if (crossR >= isco_ && crossR <= outerDisk) {
+                    double crossPhi = state.phi + (next.phi - state.phi) * t;
+                    hit.type = HitType::Disk;
+                    hit.point = bh_.position() + toScene(cartesian(crossR, M_PI / 2.0, crossPhi));
+                    hit.flareDistance = crossR;
+                    hit.redshift = diskRedshift(crossR, lambda, energy);
+                    hit.pathLength = -(state.time + (next.time - state.time) * t);
+                    return hit;
+                }
+            }
+
+            state = next;
+            if (state.r < horizon_ * KerrConfig::HORIZON_MARGIN) {
+                hit.type = HitType::Horizon;
+                return hit;
+            }
+            Vec3 current = cartesian(state.r, state.theta, state.phi);
+            if (state.r > escape && state.vr < 0.0) {  // Backwards in Mino time, so outgoing has r' < 0
+                hit.type = HitType::Escaped;
+                hit.direction = toScene((current - previous).normalize());
+                return hit;
+            }
+            previous = current;
+        }
+
+        // Out of steps: treat as captured (only near-critical orbits get here)
+        hit.type = HitType::Horizon;
+        return hit;
+    }
+};
+
+// =============================================================================
+// Hotspot light curves
+// =============================================================================
+
+/**
+ * Lensing map file: header, then the four per-pixel arrays in LensingMap order
+ */
+struct LensingMapHeader {
+    char magic[4];          // "BHLM"
+    uint32_t version;
+    uint32_t width, height;
+    double spin;
+    double camera[3];
+    double fieldOfView;
+};
+
+/**
+ * Where every pixel of a view lands on the disk, stored structure-of-arrays:
+ * Boyer-Lindquist radius and azimuth of the first disk crossing, photon
+ * redshift and the coordinate time the light takes to reach the camera.
+ * Pixels that miss the disk have radius -1.
+ */
+struct LensingMap {
+    int width = 0, height = 0;
+    std::vector<float> radius, phi, redshift, delay;
+
+    /**
+     * Trace the map for a Kerr hole (spin 0 for Schwarzschild) from cam
+     */
+    void trace(const Camera& cam, const KerrBlackHole& kerr, const BlackHole& bh, int w, int h, ThreadPool& pool) {
+        width = w;
+        height = h;
+        size_t pixels = size_t(w) * h;
+        radius.assign(pixels, -1.0f);
+        phi.assign(pixels, 0.0f);
+        redshift.assign(pixels, 0.0f);
+        delay.assign(pixels, 0.0f);
+
+        double a = kerr.spin() * bh.mass();
+        parallelFor(pool, h, [&](int y) {
+            for (int x = 0; x < w; ++x) {
+                RayHit hit = kerr.trace(cam.position(), cam.getRayDirection(x + 0.5, y + 0.5, w, h));
+                if (hit.type != HitType::Disk) {
+                    continue;
+                }
+                Vec3 local = hit.point - bh.position();
+                size_t i = size_t(y) * w + x;
+                radius[i] = float(std::sqrt(std::max(0.0, local.x() * local.x() + local.z() * local.z() - a * a)));
+                phi[i] = float(std::atan2(local.x(), local.z()));  // Azimuth in the hole's spin frame
+                redshift[i] = float(hit.redshift);
+                delay[i] = float(hit.pathLength);
+            }
+        });
+    }
+
+    bool save(const std::string& filename, const LensingMapHeader& header) const {
+        std::ofstream out(filename, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const std::vector<float>* array : {&radius, &phi, &redshift, &delay}) {
+            out.write(reinterpret_cast<const char*>(array->data()), std::streamsize(array->size() * sizeof(float)));
+        }
+        return bool(out);
+    }
+
+    /**
+     * Load a map saved for exactly the same view
+     */
+    bool load(const std::string& filename, const LensingMapHeader& expected) {
+        std::ifstream in(filename, std::ios::binary);
+        LensingMapHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(&header, &expected, sizeof(header)) != 0) {
+            return false;
+        }
+        width = int(header.width);
+        height = int(header.height);
+        for (std::vector<float>* array : {&radius, &phi, &redshift, &delay}) {
+            array->resize(size_t(width) * height);
+            in.read(reinterpret_cast<char*>(array->data()), std::streamsize(array->size() * sizeof(float)));
+        }
+        return bool(in);
+    }
+};
+
+/**
+ * Flux of a Gaussian spot on a circular Keplerian orbit in the disk plane,
+ * summed over a lensing map. Only pixels within CUTOFF_SIGMAS of the orbit
+ * are kept, compacted into flat arrays, and everything that does not depend
+ * on time is folded in up front: a pixel at (r, phi) with delay T sees the
+ * spot where it was at t - T, so with alpha = phi + Omega T its intensity is
+ *   w exp(k (cos(alpha) cos(Omega t) + sin(alpha) sin(Omega t) - 1))
+ * for a per-pixel weight w (g^4 times the radial Gaussian) and k = r rs / sigma^2.
+ * The spot moves in +phi, the same sense as the disk gas diskRedshift
+ * assumes, so the beaming peak falls while it approaches the camera.
+ * Each time step is then one branch-free multiply-add-exp pass the
+ * compiler vectorizes.
+ */
+class HotspotLightCurve {
+private:
+    std::vector<float> weight_, sharpness_, cosAlpha_, sinAlpha_;
+    double omega_ = 0.0;
+
+public:
+    HotspotLightCurve(const LensingMap& map, double mass, double spin, double orbitRadius, double spotSize) {
+        double sqrtM = std::sqrt(mass);
+        omega_ = sqrtM / (orbitRadius * std::sqrt(orbitRadius) + spin * mass * sqrtM);
+        double inverseVariance = 1.0 / (spotSize * spotSize);
+
+        for (size_t i = 0; i < map.radius.size(); ++i) {
+            double r = map.radius[i];
+            if (r < 0.0 || std::abs(r - orbitRadius) > LightCurveConfig::CUTOFF_SIGMAS * spotSize) {
+                continue;
+            }
+            double alpha = map.phi[i] + omega_ * map.delay[i];
+            weight_.push_back(float(std::pow(map.redshift[i], LightCurveConfig::INTENSITY_EXPONENT) *
+                                    std::exp(-0.5 * (r - orbitRadius) * (r - orbitRadius) * inverseVariance)));
+            sharpness_.push_back(float(r * orbitRadius * inverseVariance));
+            cosAlpha_.push_back(float(std::cos(alpha)));
+            sinAlpha_.push_back(float(std::sin(alpha)));
+        }
+    }
+
+    size_t pixels() const { return weight_.size(); }
+    double period() const { return 2.0 * M_PI / omega_; }
+
+    /**
+     * Summed spot intensity seen at observer time t
+     */
+    double flux(double t) const {
+        float c = float(std::cos(omega_ * t)), s = float(std::sin(omega_ * t));
+        const float* weight = weight_.data();
+        const float* sharpness = sharpness_.data();
+        const float* cosAlpha = cosAlpha_.data();
+        const float* sinAlpha = sinAlpha_.data();
+
+        double total = 0.0;
+        for (size_t start = 0; start < weight_.size(); start += LightCurveConfig::SUM_BLOCK) {
+            size_t end = std::min(weight_.size(), start + LightCurveConfig::SUM_BLOCK);
+            float partial = 0.0f;
+            for (size_t i = start; i < end; ++i) {
+                float exponent = sharpness[i] * (cosAlpha[i] * c + sinAlpha[i] * s - 1.0f);
+                partial += weight[i] * std::exp(std::max(LightCurveConfig::MIN_EXPONENT, exponent));
+            }
+            total += partial;
+        }
+        return total;
+    }
+};
+
+// =============================================================================
+// Multi-band rendering
+// =============================================================================
+
+/**
+ * One spectral band. Frequencies are in units of k T / h at the disk's
+ * peak temperature; thermal bands see a local blackbody, synchrotron bands
+ * a power law
+ */
+struct SpectralBand {
+    enum class Model { Thermal, Synchrotron };
+    std::string name;
+    double frequency;
+    Model model;
+};
+
+/**
+ * Radio, infrared, optical and X-ray bands
+ */
+std::vector<SpectralBand> defaultSpectralBands() {
+    return {
+        {"radio", 1e-3, SpectralBand::Model::Synchrotron},
+        {"ir", 0.1, SpectralBand::Model::Thermal},
+        {"optical", 1.0, SpectralBand::Model::Thermal},
+        {"xray", 10.0, SpectralBand::Model::Thermal}
+    };
+}
+
+/**
+ * Bands named in a comma-separated list, in list order; an unknown name is
+ * reported along with the valid ones and fails the parse
+ */
+bool parseSpectralBands(const std::string& list, std::vector<SpectralBand>& bands) {
+    std::vector<SpectralBand> known = defaultSpectralBands();
+    std::istringstream names(list);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        auto band = std::find_if(known.begin(), known.end(), [&](const SpectralBand& b) { return b.name == name; });
+        if (band == known.end()) {
+            std::cerr << "Unknown band '" << name << "', valid bands are ";
+            for (size_t i = 0; i < known.size(); ++i) {
+                std::cerr << (i > 0 ? ", " : "") << known[i].name;
+            }
+            std::cerr << "\n";
+            return false;
+        }
+        bands.push_back(*band);
+    }
+    return true;
+}
+
+/**
+ * Geodesic outcome of every pixel that matters for band shading, kept as
+ * flat arrays of the disk-hit pixels only
+ */
+struct SpectralHits {
+    int width = 0, height = 0;
+    std::vector<uint32_t> pixel;    // Image index of each disk hit
+    std::vector<double> radius;     // Boyer-Lindquist radius of the hit
+    std::vector<double> redshift;   // Observed over emitted photon energy
+};
+
+/**
+ * Disk temperature at radius r for a zero-torque inner edge at innerRadius,
+ * T ~ (r^-3 (1 - sqrt(rin / r)))^(1/4), normalized to 1 at its peak
+ * (r = 49/36 rin)
+ */
+double diskTemperature(double r, double innerRadius) {
+    auto profile = [innerRadius](double radius) {
+        return std::pow(std::max(0.0, 1.0 - std::sqrt(innerRadius / radius)) / (radius * radius * radius), 0.25);
+    };
+    return profile(r) / profile(49.0 / 36.0 * innerRadius);
+}
+
+/**
+ * Observed specific intensity of one band for a disk hit: the emitted
+ * spectrum at nu / g, times g^3
+ */
+double bandIntensity(const SpectralBand& band, double r, double g, double innerRadius) {
+    double emitted = band.frequency / g;
+    double intensity;
+    if (band.model == SpectralBand::Model::Synchrotron) {
+        intensity = std::pow(r / innerRadius, -SpectralConfig::SYNCHROTRON_RADIAL_SLOPE) *
+                    std::pow(emitted, -SpectralConfig::SYNCHROTRON_INDEX);
+    } else {
+        double temperature = diskTemperature(r, innerRadius);
+        double x = emitted / std::max(temperature, 1e-6);
+        intensity = x < 700.0 ? emitted * emitted * emitted / std::expm1(x) : 0.0;
+    }
+    return g * g * g * intensity;
+}
+
+/**
+ * Trace every pixel once with the Kerr tracer (spin 0 for Schwarzschild)
+ */
+SpectralHits traceSpectralHits(const Camera& cam, const KerrBlackHole& kerr, const BlackHole& bh, int w, int h,
+                               ThreadPool& pool) {
+    std::vector<RayHit> hits(size_t(w) * h);
+    parallelFor(pool, h, [&](int y) {
+        for (int x = 0; x < w; ++x) {
+            hits[size_t(y) * w + x] = kerr.trace(cam.position(), cam.getRayDirection(x + 0.5, y + 0.5, w, h));
+        }
+    });
+
+    SpectralHits result;
+    result.width = w;
+    result.height = h;
+    double a = kerr.spin() * bh.mass();
+    for (size_t i = 0; i < hits.size(); ++i) {
+        if (hits[i].type != HitType::Disk) {
+            continue;
+        }
+        Vec3 local = hits[i].point - bh.position();
+        result.pixel.push_back(uint32_t(i));
+        result.radius.push_back(std::sqrt(std::max(0.0, local.x() * local.x() + local.z() * local.z() - a * a)));
+        result.redshift.push_back(hits[i].redshift);
+    }
+    return result;
+}
+
+/**
+ * Shade every band from one set of traced hits into the channels of a
+ * float image (one channel per band); each band is a single pass over the
+ * disk-hit arrays, split over the pool
+ */
+FloatImage shadeSpectralBands(const SpectralHits& hits, const std::vector<SpectralBand>& bands, double innerRadius,
+                              ThreadPool& pool) {
+    FloatImage image(hits.width, hits.height, int(bands.size()));
+    int count = int(hits.pixel.size());
+    const int chunk = 4096;
+    for (size_t b = 0; b < bands.size(); ++b) {
+        parallelFor(pool, (count + chunk - 1) / chunk, [&](int block) {
+            for (int i = block * chunk; i < std::min(count, (block + 1) * chunk); ++i) {
+                image.pixels[size_t(hits.pixel[i]) * bands.size() + b] =
+                    float(bandIntensity(bands[b], hits.radius[i], hits.redshift[i], innerRadius));
+            }
+        });
+    }
+    return image;
+}
+
+// =============================================================================
+// Test-particle accretion flow
+// =============================================================================
+
+/**
+ * Disk of test particles orbiting a BlackHole. Positions, velocities and
+ * accelerations live in separate flat arrays; each step is a kick-drift-kick
+ * leapfrog under the hole's gravitationalField, scaled by the
+ * Paczynski-Wiita factor (r / (r - rs))^2 so orbits become unstable inside
+ * 3 rs as in general relativity. A weak azimuthal drag, applied as a split
+ * operator after each step, lets gas spiral in; particles that plunge or
+ * escape are respawned at the outer edge, keeping the disk in a steady state.
+ *
+ * After every frame the particles are binned into a polar grid of surface
+ * density (per-task grids merged afterwards, so deposition needs no atomics).
+ */
+class ParticleDisk {
+private:
+    const BlackHole& bh_;
+    std::vector<double> x_, y_, z_, vx_, vy_, vz_, ax_, ay_, az_;
+    std::vector<double> density_;   // Relative surface density, radial-major
+    double innerRadius_, outerRadius_;
+    uint64_t seed_;
+    int frame_ = 0;
+
+    /**
+     * Pseudo-Newtonian acceleration at p
+     */
+    Vec3 acceleration(const Vec3& p) const {
+        double r = p.distanceTo(bh_.position());
+        double factor = r / std::max(r - bh_.schwarzschildRadius(), 1e-6);
+        return bh_.gravitationalField(p) * (factor * factor);
+    }
+
+    /**
+     * Put particle i on a circular orbit at radius r and azimuth phi
+     */
+    void place(size_t i, double r, double phi, double height) {
+        double speed = std::sqrt(r * acceleration(bh_.position() + Vec3(r, 0, 0)).length());
+        x_[i] = bh_.position().x() + r * std::cos(phi);
+        y_[i] = bh_.position().y() + height;
+        z_[i] = bh_.position().z() + r * std::sin(phi);
+        vx_[i] = -speed * std::sin(phi);
+        vy_[i] = 0.0;
+        vz_[i] = speed * std::cos(phi);
+        Vec3 a = acceleration(Vec3(x_[i], y_[i], z_[i]));
+        ax_[i] = a.x();
+        ay_[i] = a.y();
+        az_[i] = a.z();
+    }
+
+    /**
+     * One kick-drift-kick step with drag for n particles. Same field as
+     * acceleration(), written out on the flat arrays (restrict-qualified
+     * parameters, since GCC ignores restrict on locals) so it vectorizes.
+     */
+    static void leapfrogStep(size_t n, double dt, double drag, double mass, double rs, double cx, double cy,
+                             double cz, double* __restrict x, double* __restrict y, double* __restrict z,
+                             double* __restrict vx, double* __restrict vy, double* __restrict vz,
+                             double* __restrict ax, double* __restrict ay, double* __restrict az) {
+        for (size_t i = 0; i < n; ++i) {
+            double hx = vx[i] + 0.5 * dt * ax[i];
+            double hy = vy[i] + 0.5 * dt * ay[i];
+            double hz = vz[i] + 0.5 * dt * az[i];
+            double dx = x[i] + dt * hx - cx;
+            double dy = y[i] + dt * hy - cy;
+            double dz = z[i] + dt * hz - cz;
+            x[i] = cx + dx;
+            y[i] = cy + dy;
+            z[i] = cz + dz;
+
+            double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+            double factor = r / std::max(r - rs, 1e-6);
+            double strength = -mass * factor * factor / (r * r * r);
+            double gx = dx * strength, gy = dy * strength, gz = dz * strength;
+            ax[i] = gx;
+            ay[i] = gy;
+            az[i] = gz;
+            hx += 0.5 * dt * gx;
+            hy += 0.5 * dt * gy;
+            hz += 0.5 * dt * gz;
+
+            // Drag on the azimuthal velocity only
+            double inverseR2 = 1.0 / std::max(dx * dx + dz * dz, 1e-12);
+            double loss = drag * (dx * hz - dz * hx) * inverseR2;  // Drag times angular velocity
+            vx[i] = hx + loss * dz;
+            vy[i] = hy;
+            vz[i] = hz - loss * dx;
+        }
+    }
+
+    /**
+     * Advance particles [begin, end) by steps leapfrog steps
+     */
+    void advance(size_t begin, size_t end, int steps, std::mt19937_64& rng) {
+        const double dt = ParticleConfig::TIME_STEP * bh_.mass();
+        const Vec3& center = bh_.position();
+        for (int step = 0; step < steps; ++step) {
+            leapfrogStep(end - begin, dt, ParticleConfig::DRAG * dt / bh_.mass(), bh_.mass(),
+                         bh_.schwarzschildRadius(), center.x(), center.y(), center.z(), &x_[begin], &y_[begin],
+                         &z_[begin], &vx_[begin], &vy_[begin], &vz_[begin], &ax_[begin], &ay_[begin], &az_[begin]);
+        }
+
+        // Respawn plunged and escaped particles (rare, so kept out of the loop above)
+        double capture = ParticleConfig::CAPTURE_RADIUS * bh_.schwarzschildRadius();
+        double escape = ParticleConfig::ESCAPE_FACTOR * outerRadius_;
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (size_t i = begin; i < end; ++i) {
+            double r = Vec3(x_[i], y_[i], z_[i]).distanceTo(center);
+            if (r < capture || r > escape) {
+                double radius = outerRadius_ * (0.9 + 0.1 * uniform(rng));
+                place(i, radius, 2.0 * M_PI * uniform(rng),
+                      ParticleConfig::THICKNESS * radius * (uniform(rng) - 0.5));
+            }
+        }
+    }
+
+    size_t cellOf(size_t i) const {
+        double dx = x_[i] - bh_.position().x(), dz = z_[i] - bh_.position().z();
+        double r = std::sqrt(dx * dx + dz * dz);
+        double u = (r - innerRadius_) / (outerRadius_ - innerRadius_) * ParticleConfig::RADIAL_BINS;
+        if (u < 0.0 || u >= ParticleConfig::RADIAL_BINS) {
+            return SIZE_MAX;
+        }
+        double v = (std::atan2(dz, dx) + M_PI) / (2.0 * M_PI) * ParticleConfig::AZIMUTHAL_BINS;
+        int phiBin = std::min(ParticleConfig::AZIMUTHAL_BINS - 1, int(v));
+        return size_t(u) * ParticleConfig::AZIMUTHAL_BINS + size_t(phiBin);
+    }
+
+public:
+    ParticleDisk(const BlackHole& bh, int count, uint64_t seed)
+        : bh_(bh), innerRadius_(bh.diskInnerRadius()), outerRadius_(bh.diskOuterRadius()), seed_(seed) {
+        for (auto* array : {&x_, &y_, &z_, &vx_, &vy_, &vz_, &ax_, &ay_, &az_}) {
+            array->resize(size_t(count));
+        }
+
+        // Uniform surface density with a two-armed logarithmic spiral on top
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        double inner2 = innerRadius_ * innerRadius_, outer2 = outerRadius_ * outerRadius_;
+        for (size_t i = 0; i < size_t(count); ++i) {
+            double r, phi;
+            do {
+                r = std::sqrt(inner2 + (outer2 - inner2) * uniform(rng));
+                phi = 2.0 * M_PI * uniform(rng);
+            } while (uniform(rng) * (1.0 + ParticleConfig::SPIRAL_CONTRAST) >
+                     1.0 + ParticleConfig::SPIRAL_CONTRAST * std::cos(2.0 * (phi - 2.0 * std::log(r))));
+            place(i, r, phi, ParticleConfig::THICKNESS * r * (uniform(rng) - 0.5));
+        }
+        density_.assign(size_t(ParticleConfig::RADIAL_BINS) * ParticleConfig::AZIMUTHAL_BINS, 0.0);
+    }
+
+    size_t size() const { return x_.size(); }
+
+    /**
+     * Advance every particle by steps leapfrog steps, then deposit the
+     * surface density; chunks are fixed, so results do not depend on the
+     * thread count
+     */
+    void update(int steps, ThreadPool& pool) {
+        int chunks = int((size() + ParticleConfig::CHUNK - 1) / ParticleConfig::CHUNK);
+        int frame = frame_++;
+        parallelFor(pool, chunks, [&](int chunk) {
+            std::mt19937_64 rng(seed_ ^ (uint64_t(frame) << 32) ^ uint64_t(chunk));
+            size_t begin = size_t(chunk) * ParticleConfig::CHUNK;
+            advance(begin, std::min(size(), begin + ParticleConfig::CHUNK), steps, rng);
+        });
+
+        const int bins = ParticleConfig::RADIAL_BINS * ParticleConfig::AZIMUTHAL_BINS;
+        SlotHistograms<uint32_t> counts(int(pool.size()), bins);
+        std::atomic<int> nextChunk(0);
+        parallelFor(pool, counts.slotCount(), [&](int slot) {
+            uint32_t* cells = counts.slot(slot);
+            for (int chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+                size_t begin = size_t(chunk) * ParticleConfig::CHUNK;
+                for (size_t i = begin; i < std::min(size(), begin + ParticleConfig::CHUNK); ++i) {
+                    size_t cell = cellOf(i);
+                    if (cell != SIZE_MAX) {
+                        ++cells[cell];
+                    }
+                }
+            }
+        });
+
+        // Relative to a uniform disk holding every particle
+        std::vector<double> total = counts.reduce(pool);
+        double ringWidth = (outerRadius_ - innerRadius_) / ParticleConfig::RADIAL_BINS;
+        double diskArea = M_PI * (outerRadius_ * outerRadius_ - innerRadius_ * innerRadius_);
+        for (int ring = 0; ring < ParticleConfig::RADIAL_BINS; ++ring) {
+            double r = innerRadius_ + (ring + 0.5) * ringWidth;
+            double cellArea = 2.0 * M_PI * r * ringWidth / ParticleConfig::AZIMUTHAL_BINS;
+            double expected = double(size()) * cellArea / diskArea;
+            for (int cell = 0; cell < ParticleConfig::AZIMUTHAL_BINS; ++cell) {
+                size_t index = size_t(ring) * ParticleConfig::AZIMUTHAL_BINS + cell;
+                density_[index] = total[index] / expected;
+            }
+        }
+    }
+
+    /**
+     * Bilinearly interpolated relative surface density at a disk-plane point
+     */
+    double density(const Vec3& point) const {
+        double dx = point.x() - bh_.position().x(), dz = point.z() - bh_.position().z();
+        double u = (std::sqrt(dx * dx + dz * dz) - innerRadius_) / (outerRadius_ - innerRadius_) *
+                       ParticleConfig::RADIAL_BINS - 0.5;
+        double v = (std::atan2(dz, dx) + M_PI) / (2.0 * M_PI) * ParticleConfig::AZIMUTHAL_BINS - 0.5;
+        u = std::max(0.0, std::min(double(ParticleConfig::RADIAL_BINS - 1), u));
+        int r0 = std::min(int(u), ParticleConfig::RADIAL_BINS - 2);
+        int p0 = int(std::floor(v));
+        double tu = u - r0, tv = v - p0;
+
+        double result = 0.0;
+        for (int dr = 0; dr < 2; ++dr) {
+            for (int dp = 0; dp < 2; ++dp) {
+                int phiBin = ((p0 + dp) % ParticleConfig::AZIMUTHAL_BINS + ParticleConfig::AZIMUTHAL_BINS) %
+                             ParticleConfig::AZIMUTHAL_BINS;
+                result += (dr ? tu : 1.0 - tu) * (dp ? tv : 1.0 - tv) *
+                          density_[size_t(r0 + dr) * ParticleConfig::AZIMUTHAL_BINS + phiBin];
+            }
+        }
+        return result;
+    }
+};
+
+/**
+ * Render a particle disk over many frames. The camera is fixed, so every
+ * pixel's geodesic (and with it the disk color before density and the sky
+ * behind) is traced once; each frame only advances the particles and
+ * scales each disk pixel by the deposited density.
+ */
+void renderParticleDisk(const Camera& cam, const BlackHole& bh, ParticleDisk& disk, int w, int h, int frames,
+                        int substeps, const std::string& prefix, ThreadPool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<RayHit> hits(size_t(w) * h);
+    std::vector<Color> base(size_t(w) * h);
+    parallelFor(pool, h, [&](int y) {
+        for (int x = 0; x < w; ++x) {
+            size_t i = size_t(y) * w + x;
+            hits[i] = traceGeodesic(cam.position(), cam.getRayDirection(x + 0.5, y + 0.5, w, h), bh);
+            base[i] = shadeHit(hits[i], bh);
+        }
+    });
+    std::cout << "Traced geodesics in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms\n";
+
+    std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+    for (int frame = 0; frame < frames; ++frame) {
+        auto frameStart = std::chrono::steady_clock::now();
+        disk.update(substeps, pool);
+        auto simulated = std::chrono::steady_clock::now();
+
+        parallelFor(pool, h, [&](int y) {
+            for (int x = 0; x < w; ++x) {
+                size_t i = size_t(y) * w + x;
+                Color pixel = hits[i].type == HitType::Disk ? base[i] * disk.density(hits[i].point) : base[i];
+                image[y][x] = pixel.enhanceContrast().clamp();
+            }
+        });
+        auto shaded = std::chrono::steady_clock::now();
+
+        char filename[256];
+        std::snprintf(filename, sizeof(filename), "%s%03d.ppm", prefix.c_str(), frame);
+        std::cout << "Frame " << (frame + 1) << "/" << frames << ": " << disk.size() << " particles stepped in "
+                  << std::chrono::duration<double, std::milli>(simulated - frameStart).count() << " ms, shaded in "
+                  << std::chrono::duration<double, std::milli>(shaded - simulated).count() << " ms\n";
+        writePPM(filename, image);
+    }
+}
+
+// =============================================================================
+// Multi-view rendering
+// =============================================================================
+
+/**
+ * Geodesics shared by observers at nearby distances from one hole. Lensing
+ * is central, so a ray stays in the plane through the hole, the observer and
+ * its direction, and its path in that plane depends only on the observer
+ * distance D and the angle theta between the ray and the hole direction.
+ * The table marches one ray per (D, theta) sample and keeps its path as
+ * (psi, r): the angle swept about the hole since leaving the observer and
+ * the distance from it. Any pixel of any view then resolves by lookup: the
+ * disk plane cuts the ray's plane along a line, so the ray can only meet
+ * the disk at psi0 + k pi, where the stored radius says whether it hits.
+ * Samples are blended across theta and D; which outcome a ray has comes from
+ * the nearest sample, so shadow and disk edges stay sharp.
+ */
+class PlanarGeodesicTable {
+private:
+    struct Path {
+        size_t begin, end;   // Range in psi_ / radius_
+        HitType terminal;    // Horizon or Escaped
+        double beta;         // Escape direction angle from the hole axis
+    };
+
+    const BlackHole& bh_;
+    double minDistance_, distanceStep_;
+    double thetaStep_;
+    int slices_, thetaSamples_;
+    std::vector<Path> paths_;     // Slice-major
+    std::vector<double> psi_, radius_;
+
+    const Path& path(int slice, int sample) const { return paths_[size_t(slice) * thetaSamples_ + sample]; }
+
+    /**
+     * Radius along a path at swept angle psi (psi inside the path)
+     */
+    double radiusAt(const Path& p, double psi) const {
+        const double* first = psi_.data() + p.begin;
+        const double* last = psi_.data() + p.end;
+        size_t k = size_t(std::upper_bound(first, last, psi) - first);
+        if (k == 0) {
+            return radius_[p.begin];
+        }
+        if (k >= p.end - p.begin) {
+            return radius_[p.end - 1];
+        }
+        size_t i = p.begin + k - 1;
+        double span = psi_[i + 1] - psi_[i];
+        double t = span > 0.0 ? (psi - psi_[i]) / span : 0.0;
+        return radius_[i] + (radius_[i + 1] - radius_[i]) * t;
+    }
+
+    double psiEnd(const Path& p) const { return psi_[p.end - 1]; }
+
+public:
+    /**
+     * Tabulate observer distances [minDistance, maxDistance] and ray angles
+     * [0, maxTheta] at thetaStep
+     */
+    PlanarGeodesicTable(const BlackHole& bh, double minDistance, double maxDistance, double maxTheta,
+                        double thetaStep, ThreadPool& pool)
+        : bh_(bh) {
+        if (maxDistance - minDistance < MultiViewConfig::DISTANCE_TOLERANCE) {
+            slices_ = 1;
+            minDistance_ = 0.5 * (minDistance + maxDistance);
+            distanceStep_ = 0.0;
+        } else {
+            slices_ = std::min(MultiViewConfig::MAX_SLICES,
+                               2 + int((maxDistance - minDistance) / MultiViewConfig::SLICE_SPACING));
+            minDistance_ = minDistance;
+            distanceStep_ = (maxDistance - minDistance) / (slices_ - 1);
+        }
+        thetaSamples_ = 2 + int(std::ceil(maxTheta / thetaStep));
+        thetaStep_ = maxTheta / (thetaSamples_ - 1);
+
+        // March in the table frame: hole axis +Z, ray side +X
+        std::vector<std::vector<double>> psis(size_t(slices_) * thetaSamples_), radii(psis.size());
+        paths_.resize(psis.size());
+        parallelFor(pool, int(psis.size()), [&](int index) {
+            double distance = minDistance_ + distanceStep_ * (index / thetaSamples_);
+            double theta = thetaStep_ * (index % thetaSamples_);
+            std::vector<double>& psi = psis[index];
+            std::vector<double>& radius = radii[index];
+            double previousAngle = M_PI;
+            auto record = [&](const Vec3& point) {
+                Vec3 offset = point - bh.position();
+                double angle = std::atan2(offset.x(), offset.z());
+                double swept = psi.empty() ? 0.0 : psi.back() + std::max(0.0, wrapAngle(previousAngle - angle));
+                previousAngle = angle;
+                psi.push_back(swept);
+                radius.push_back(offset.length());
+            };
+
+            Vec3 end;
+            RayHit hit = marchGeodesic(bh.position() - Vec3(0, 0, distance),
+                                       Vec3(std::sin(theta), 0, std::cos(theta)), bh,
+                                       [](const RayHit&) { return false; },
+                                       [&](const Vec3& start, const Vec3& direction, double length) {
+                                           record(start);
+                                           end = start + direction * length;
+                                           return true;
+                                       });
+            if (!psi.empty()) {
+                record(end);
+            } else {
+                record(bh.position() - Vec3(0, 0, distance));
+            }
+            paths_[index].terminal = hit.type;
+            paths_[index].beta = hit.type == HitType::Escaped ? std::atan2(hit.direction.x(), hit.direction.z()) : 0.0;
+        });
+
+        for (size_t i = 0; i < psis.size(); ++i) {
+            paths_[i].begin = psi_.size();
+            psi_.insert(psi_.end(), psis[i].begin(), psis[i].end());
+            radius_.insert(radius_.end(), radii[i].begin(), radii[i].end());
+            paths_[i].end = psi_.size();
+        }
+    }
+
+    int slices() const { return slices_; }
+    int thetaSamples() const { return thetaSamples_; }
+
+    /**
+     * Outcome of a ray from observer along direction, as traceGeodesic
+     * would report it
+     */
+    RayHit trace(const Vec3& observer, const Vec3& direction) const {
+        Vec3 offset = observer - bh_.position();
+        double distance = offset.length();
+        Vec3 axis = offset * (-1.0 / distance);
+        double cosTheta = std::max(-1.0, std::min(1.0, direction.dot(axis)));
+        Vec3 side = direction - axis * cosTheta;
+        if (side.length() < 1e-12) {
+            side = axis.cross(std::abs(axis.y()) < 0.9 ? Vec3(0, 1, 0) : Vec3(1, 0, 0));
+        }
+        side = side.normalize();
+
+        // Bilinear weights over (slice, theta sample)
+        double u = slices_ > 1 ? std::max(0.0, std::min(double(slices_ - 1), (distance - minDistance_) / distanceStep_))
+                               : 0.0;
+        double v = std::min(double(thetaSamples_ - 1), std::acos(cosTheta) / thetaStep_);
+        int s0 = std::min(int(u), std::max(0, slices_ - 2)), t0 = std::min(int(v), thetaSamples_ - 2);
+        double su = slices_ > 1 ? u - s0 : 0.0, tv = v - t0;
+        const Path* neighbours[4] = {&path(s0, t0), &path(s0, t0 + 1), &path(std::min(s0 + 1, slices_ - 1), t0),
+                                     &path(std::min(s0 + 1, slices_ - 1), t0 + 1)};
+        double weights[4] = {(1 - su) * (1 - tv), (1 - su) * tv, su * (1 - tv), su * tv};
+        int nearest = int(std::max_element(weights, weights + 4) - weights);
+        const Path& dominant = *neighbours[nearest];
+
+        RayHit hit;
+        auto planePoint = [&](double psi, double r) {
+            return bh_.position() + (axis * -std::cos(psi) + side * std::sin(psi)) * r;
+        };
+
+        // Marcher-to-disk distance when the crossing is detected: replay the
+        // marcher's disk-plane test (along the direction it arrived with)
+        // from the recorded steps just before the crossing
+        auto detectionDistance = [&](const Path& p, double psi, const Vec3& crossing) {
+            size_t k = size_t(std::upper_bound(psi_.data() + p.begin, psi_.data() + p.end, psi) - psi_.data());
+            for (size_t j = k > p.begin + 3 ? k - 3 : p.begin; j < k; ++j) {
+                Vec3 position = planePoint(psi_[j], radius_[j]);
+                Vec3 arrival = j > p.begin ? (position - planePoint(psi_[j - 1], radius_[j - 1])).normalize() : direction;
+                Vec3 point;
+                if (bh_.intersectsDiskPlane(position, arrival, point)) {
+                    double distance = position.distanceTo(point);
+                    if (distance < 2.0 * adaptiveStepSize(radius_[j], bh_)) {
+                        return distance;
+                    }
+                }
+            }
+            return planePoint(psi_[k - 1], radius_[k - 1]).distanceTo(crossing);
+        };
+
+        // Disk plane crossings, in the order the ray meets them
+        double firstCrossing = std::atan2(axis.y(), side.y());
+        if (firstCrossing <= 0.0) {
+            firstCrossing += M_PI;
+        }
+        for (double psi = firstCrossing; psi <= psiEnd(dominant); psi += M_PI) {
+            double r = radiusAt(dominant, psi);
+            if (r < bh_.diskInnerRadius() || r > bh_.diskOuterRadius()) {
+                continue;
+            }
+            double blended = 0.0, total = 0.0;
+            for (int i = 0; i < 4; ++i) {
+                if (weights[i] > 0.0 && psi <= psiEnd(*neighbours[i])) {
+                    blended += weights[i] * radiusAt(*neighbours[i], psi);
+                    total += weights[i];
+                }
+            }
+            r = blended / total;
+            hit.type = HitType::Disk;
+            hit.point = planePoint(psi, r);
+            hit.point = Vec3(hit.point.x(), bh_.position().y(), hit.point.z());
+            hit.flareDistance = r;
+            hit.hitDistance = detectionDistance(dominant, psi, hit.point);
+            return hit;
+        }
+
+        hit.type = dominant.terminal;
+        if (hit.type == HitType::Escaped) {
+            double beta = 0.0, total = 0.0;
+            for (int i = 0; i < 4; ++i) {
+                if (weights[i] > 0.0 && neighbours[i]->terminal == HitType::Escaped) {
+                    beta += weights[i] * wrapAngle(neighbours[i]->beta - dominant.beta);
+                    total += weights[i];
+                }
+            }
+            beta = dominant.beta + beta / total;
+            hit.direction = axis * std::cos(beta) + side * std::sin(beta);
+        }
+        return hit;
+    }
+};
+
+/**
+ * Render several views of one hole from a shared PlanarGeodesicTable, with
+ * the same 2x2 supersampling and post-processing as render(). The table
+ * spans every view's observer distance and ray angles, at a theta spacing
+ * finer than a pixel; per view only table lookups remain.
+ */
+std::vector<std::vector<std::vector<Color>>> renderMultiView(const std::vector<Camera>& views, const BlackHole& bh,
+                                                             int w, int h, ThreadPool& pool) {
+    double minDistance = 1e300, maxDistance = 0.0, maxTheta = 0.0, thetaStep = 1e300;
+    for (const Camera& cam : views) {
+        double distance = cam.position().distanceTo(bh.position());
+        minDistance = std::min(minDistance, distance);
+        maxDistance = std::max(maxDistance, distance);
+        Vec3 axis = (bh.position() - cam.position()).normalize();
+
+        // Angle from the axis is largest at a frame corner unless the frame
+        // reaches past 90 degrees from it
+        for (int corner = 0; corner < 4; ++corner) {
+            Vec3 ray = cam.getRayDirection((corner & 1) * w, (corner >> 1) * h, w, h);
+            double theta = std::acos(std::max(-1.0, std::min(1.0, ray.dot(axis))));
+            maxTheta = std::max(maxTheta, theta > 0.5 * M_PI ? M_PI : theta);
+        }
+        double pixelAngle = 2.0 * std::tan(cam.fieldOfView() * 0.5) / std::max(w, h);
+        thetaStep = std::min(thetaStep, pixelAngle / MultiViewConfig::THETA_OVERSAMPLING);
+    }
+    maxTheta = std::min(M_PI, maxTheta + thetaStep);
+
+    auto start = std::chrono::steady_clock::now();
+    PlanarGeodesicTable table(bh, minDistance, maxDistance, maxTheta, thetaStep, pool);
+    std::cout << "Traced " << table.slices() << "x" << table.thetaSamples() << " shared geodesics in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms\n";
+
+    std::vector<std::vector<std::vector<Color>>> images;
+    for (size_t v = 0; v < views.size(); ++v) {
+        const Camera& cam = views[v];
+        auto viewStart = std::chrono::steady_clock::now();
+        std::vector<std::vector<Color>> image(h, std::vector<Color>(w));
+        parallelFor(pool, h, [&](int y) {
+            for (int x = 0; x < w; ++x) {
+                Color pixelSum(0, 0, 0);
+                for (int dx = 0; dx < 2; ++dx) {
+                    for (int dy = 0; dy < 2; ++dy) {
+                        Vec3 direction = cam.getRayDirection(x + (dx + 0.5) * 0.5, y + (dy + 0.5) * 0.5, w, h);
+                        pixelSum = pixelSum + shadeHit(table.trace(cam.position(), direction), bh);
+                    }
+                }
+                image[y][x] = (pixelSum * 0.25).enhanceContrast().clamp();
+            }
+        });
+        std::cout << "View " << (v + 1) << "/" << views.size() << " resolved in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - viewStart).count()
+                  << " ms\n";
+        images.push_back(std::move(image));
+    }
+    return images;
+}
+
+// =============================================================================
+// Synthetic interferometry
+// =============================================================================
+
+/**
+ * In-place radix-2 complex FFT of a row-major power-of-two grid. Rows are
+ * transformed in parallel where they lie; columns are gathered
+ * COLUMN_BLOCK at a time into a contiguous per-task buffer (bit-reversed on
+ * the way in), transformed there while cache resident, and scattered back.
+ * Twiddles and permutations are built once, so one plan serves every frame.
+ */
+class FFT2D {
+private:
+    using Complex = std::complex<double>;
+
+    int width_, height_;
+    std::vector<Complex> rowTwiddles_, columnTwiddles_;
+    std::vector<int> rowReversal_, columnReversal_;
+
+    static void plan(int n, std::vector<Complex>& twiddles, std::vector<int>& reversal) {
+        twiddles.resize(size_t(n / 2));
+        for (int k = 0; k < n / 2; ++k) {
+            twiddles[k] = std::polar(1.0, -2.0 * M_PI * k / n);
+        }
+        reversal.assign(size_t(n), 0);
+        for (int i = 1, j = 0; i < n; ++i) {
+            int bit = n >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+            reversal[i] = j;
+        }
+    }
+
+    /**
+     * Butterfly passes over n bit-reversed values
+     */
+    static void butterflies(Complex* data, int n, const Complex* twiddles, bool inverse) {
+        for (int length = 2; length <= n; length <<= 1) {
+            int half = length / 2, stride = n / length;
+            for (int start = 0; start < n; start += length) {
+                for (int k = 0; k < half; ++k) {
+                    Complex w = inverse ? std::conj(twiddles[k * stride]) : twiddles[k * stride];
+                    Complex a = data[start + k], b = data[start + k + half] * w;
+                    data[start + k] = a + b;
+                    data[start + k + half] = a - b;
+                }
+            }
+        }
+    }
+
+public:
+    FFT2D(int width, int height) : width_(width), height_(height) {
+        plan(width, rowTwiddles_, rowReversal_);
+        plan(height, columnTwiddles_, columnReversal_);
+    }
+
+    static int nextPowerOfTwo(int n) {
+        int p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    /**
+     * Forward (e^-2pi i) or inverse (scaled by 1 / (width height)) transform
+     */
+    void transform(std::vector<Complex>& grid, bool inverse, ThreadPool& pool) const {
+        parallelFor(pool, height_, [&](int y) {
+            Complex* row = grid.data() + size_t(y) * width_;
+            for (int x = 0; x < width_; ++x) {
+                if (x < rowReversal_[x]) {
+                    std::swap(row[x], row[rowReversal_[x]]);
+                }
+            }
+            butterflies(row, width_, rowTwiddles_.data(), inverse);
+        });
+
+        const int block = InterferometryConfig::COLUMN_BLOCK;
+        double scale = inverse ? 1.0 / (double(width_) * height_) : 1.0;
+        parallelFor(pool, (width_ + block - 1) / block, [&](int b) {
+            int first = b * block, count = std::min(block, width_ - first);
+            std::vector<Complex> columns(size_t(count) * height_);
+            for (int y = 0; y < height_; ++y) {
+                const Complex* row = grid.data() + size_t(y) * width_ + first;
+                for (int c = 0; c < count; ++c) {
+                    columns[size_t(c) * height_ + columnReversal_[y]] = row[c];
+                }
+            }
+            for (int c = 0; c < count; ++c) {
+                butterflies(columns.data() + size_t(c) * height_, height_, columnTwiddles_.data(), inverse);
+            }
+            for (int y = 0; y < height_; ++y) {
+                Complex* row = grid.data() + size_t(y) * width_ + first;
+                for (int c = 0; c < count; ++c) {
+                    row[c] = columns[size_t(c) * height_ + y] * scale;
+                }
+            }
+        });
+    }
+};
+
+/**
+ * Synthetic interferometric observation of float frames. A frame of
+ * intensities on pixels angleX by angleY radians (not necessarily square)
+ * is zero-padded, centred on the grid origin (so the frame centre is the
+ * phase centre) and transformed once. The complex visibility
+ *   V(u, v) = sum I(l, m) e^{-2 pi i (u l + v m)} angleX angleY
+ * at baselines (u, v) in wavelengths is read off the padded grid by
+ * Catmull-Rom interpolation, with l along image x and m along image rows. The
+ * same spectrum times the transfer function of a circular Gaussian beam
+ * (FWHM in radians), transformed back, gives the beam-convolved frame (the
+ * beam has unit sum, so surface brightness is preserved).
+ */
+class SyntheticObservation {
+public:
+    using Complex = std::complex<double>;
+
+    struct Result {
+        std::vector<Complex> visibilities;   // One per (u, v) point
+        FloatImage convolved;
+    };
+
+private:
+    int width_, height_;
+    double angleX_, angleY_;   // Pixel width and height (radians)
+    FFT2D fft_;
+    std::vector<double> beamX_, beamY_;   // Separable beam transfer along each grid axis
+
+    static std::vector<double> beamTransfer(int n, double sigma) {
+        std::vector<double> transfer(n);
+        for (int k = 0; k < n; ++k) {
+            double frequency = double(k < n / 2 ? k : k - n) / n;   // Cycles per pixel
+            transfer[k] = std::exp(-2.0 * M_PI * M_PI * sigma * sigma * frequency * frequency);
+        }
+        return transfer;
+    }
+
+    /**
+     * Catmull-Rom weights of the samples at offsets -1..2 for position t in [0, 1)
+     */
+    static void catmullRomWeights(double t, double weights[4]) {
+        double t2 = t * t, t3 = t2 * t;
+        weights[0] = 0.5 * (-t3 + 2.0 * t2 - t);
+        weights[1] = 0.5 * (3.0 * t3 - 5.0 * t2 + 2.0);
+        weights[2] = 0.5 * (-3.0 * t3 + 4.0 * t2 + t);
+        weights[3] = 0.5 * (t3 - t2);
+    }
+
+public:
+    SyntheticObservation(int width, int height, double angleX, double angleY, int padding, double beamFwhm)
+        : width_(width), height_(height), angleX_(angleX), angleY_(angleY),
+          fft_(FFT2D::nextPowerOfTwo(width * std::max(1, padding)),
+               FFT2D::nextPowerOfTwo(height * std::max(1, padding))) {
+        double sigma = beamFwhm / (2.0 * std::sqrt(2.0 * std::log(2.0)));
+        beamX_ = beamTransfer(fft_.width(), sigma / angleX);
+        beamY_ = beamTransfer(fft_.height(), sigma / angleY);
+    }
+
+    int gridWidth() const { return fft_.width(); }
+    int gridHeight() const { return fft_.height(); }
+
+    /**
+     * Visibilities at uv (pairs of u, v) and the beam-convolved image of
+     * one channel of frame
+     */
+    Result observe(const FloatImage& frame, int channel, const std::vector<std::pair<double, double>>& uv,
+                   ThreadPool& pool) const {
+        const int gw = fft_.width(), gh = fft_.height();
+        std::vector<Complex> grid(size_t(gw) * gh);
+        auto gridIndex = [&](int x, int y) {
+            int gx = (x - width_ / 2 + gw) % gw, gy = (y - height_ / 2 + gh) % gh;
+            return size_t(gy) * gw + gx;
+        };
+        parallelFor(pool, height_, [&](int y) {
+            for (int x = 0; x < width_; ++x) {
+                grid[gridIndex(x, y)] = frame.at(x, y, channel);
+            }
+        });
+        fft_.transform(grid, false, pool);
+
+        Result result;
+        double pixelArea = angleX_ * angleY_;
+        for (const auto& point : uv) {
+            double fu = point.first * angleX_ * gw, fv = point.second * angleY_ * gh;
+            int u0 = int(std::floor(fu)), v0 = int(std::floor(fv));
+            double wu[4], wv[4];
+            catmullRomWeights(fu - u0, wu);
+            catmullRomWeights(fv - v0, wv);
+            Complex sum = 0.0;
+            for (int dv = -1; dv <= 2; ++dv) {
+                for (int du = -1; du <= 2; ++du) {
+                    int gx = ((u0 + du) % gw + gw) % gw, gy = ((v0 + dv) % gh + gh) % gh;
+                    sum += grid[size_t(gy) * gw + gx] * (wu[du + 1] * wv[dv + 1]);
+                }
+            }
+            result.visibilities.push_back(sum * pixelArea);
+        }
+
+        parallelFor(pool, gh, [&](int y) {
+            Complex* row = grid.data() + size_t(y) * gw;
+            for (int x = 0; x < gw; ++x) {
+                row[x] *= beamX_[x] * beamY_[y];
+            }
+        });
+        fft_.transform(grid, true, pool);
+
+        result.convolved = FloatImage(width_, height_);
+        parallelFor(pool, height_, [&](int y) {
+            for (int x = 0; x < width_; ++x) {
+                result.convolved.at(x, y) = float(grid[gridIndex(x, y)].real());
+            }
+        });
+        return result;
+    }
+};
+
+/**
+ * Default uv coverage: baselines of evenly spaced lengths up to
+ * MAX_UV_FRACTION of the Nyquist frequency of the coarser pixel axis
+ * (pixelAngle is that axis's pixel size), each at evenly spaced
+ * position angles over half a turn (the other half is the complex
+ * conjugate)
+ */
+std::vector<std::pair<double, double>> defaultUvCoverage(double pixelAngle) {
+    std::vector<std::pair<double, double>> uv;
+    double longest = InterferometryConfig::MAX_UV_FRACTION * 0.5 / pixelAngle;
+    for (int b = 1; b <= InterferometryConfig::DEFAULT_BASELINES; ++b) {
+        double length = longest * b / InterferometryConfig::DEFAULT_BASELINES;
+        for (int a = 0; a < InterferometryConfig::DEFAULT_POSITION_ANGLES; ++a) {
+            double angle = M_PI * a / InterferometryConfig::DEFAULT_POSITION_ANGLES;
+            uv.emplace_back(length * std::cos(angle), length * std::sin(angle));
+        }
+    }
+    return uv;
+}
+
+// =============================================================================
+// Command line
+// =============================================================================
+
+/**
+ * Minimal --key=value command line parser
+ */
+class CommandLine {
+private:
+    std::map<std::string, std::string> options_;
+
+public:
+    CommandLine(int argc, char* argv[]) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.compare(0, 2, "--") != 0) {
+                continue;
+            }
+            size_t equals = arg.find('=');
+            if (equals == std::string::npos) {
+                options_[arg.substr(2)] = "1";
+            } else {
+                options_[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+            }
+        }
+    }
+
+    bool has(const std::string& key) const {
+        return options_.count(key) > 0;
+    }
+
+    std::string getString(const std::string& key, const std::string& fallback) const {
+        auto it = options_.find(key);
+        return it != options_.end() ? it->second : fallback;
+    }
+
+    int getInt(const std::string& key, int fallback) const {
+        auto it = options_.find(key);
+        return it != options_.end() ? std::atoi(it->second.c_str()) : fallback;
+    }
+
+    double getDouble(const std::string& key, double fallback) const {
+        auto it = options_.find(key);
+        return it != options_.end() ? std::atof(it->second.c_str()) : fallback;
+    }
+
+    std::vector<double> getList(const std::string& key, const std::vector<double>& fallback) const {
+        auto it = options_.find(key);
+        if (it == options_.end()) {
+            return fallback;
+        }
+        std::vector<double> values;
+        std::istringstream items(it->second);
+        std::string item;
+        while (std::getline(items, item, ',')) {
+            values.push_back(std::atof(item.c_str()));
+        }
+        return values;
+    }
+
+    Vec3 getVec3(const std::string& key, const Vec3& fallback) const {
+        auto it = options_.find(key);
+        double x, y, z;
+        if (it == options_.end() || std::sscanf(it->second.c_str(), "%lf,%lf,%lf", &x, &y, &z) != 3) {
+            return fallback;
+        }
+        return Vec3(x, y, z);
+    }
+};
+
+/**
+ * Preset camera positions rendered by the still-image modes
+ */
+std::vector<Vec3> presetViewPositions() {
+    return {
+        Vec3(0, 2, -8),    // Original view
+        Vec3(-6, 1, -4),   // Side angle
+        Vec3(0, 5, -6)     // Top-down view
+    };
+}
+
+/**
+ * Still-image modes: render every preset view with the selected renderer
+ */
+int runViewsMode(const std::string& mode, const CommandLine& args, int width, int height) {
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+
+    // Multiple camera angles
+    std::vector<Vec3> positions = presetViewPositions();
+
+    for (size_t i = 0; i < positions.size(); ++i) {
+        Vec3 camPos = positions[i];
+        Vec3 camDir = (Vec3(0, 0, 0) - camPos).normalize();
+        Vec3 camUp(0, 1, 0);
+        Camera cam(camPos, camDir, camUp, RenderConfig::FOV);
+
+        std::cout << "Rendering view " << (i + 1) << "/" << positions.size() << "...\n";
+        if (mode == "upscale") {
+            std::string filename = "black_hole_upscaled_" + std::to_string(i + 1) + ".ppm";
+            int factor = args.getInt("factor", UpscaleConfig::DEFAULT_FACTOR);
+            renderUpscaled(cam, bh, width, height, factor, filename);
+        } else if (mode == "quadtree") {
+            std::string filename = "black_hole_quadtree_" + std::to_string(i + 1) + ".ppm";
+            renderQuadtree(cam, bh, width, height, filename);
+        } else {
+            std::string filename = "black_hole_" + std::to_string(i + 1) + ".ppm";
+            render(cam, bh, width, height, filename);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Preview mode: checkerboard-rendered orbit around the first preset view
+ */
+int runPreviewMode(const CommandLine& args, int width, int height) {
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    int frames = args.getInt("frames", PreviewConfig::DEFAULT_FRAMES);
+    double step = args.getDouble("orbit-step", PreviewConfig::ORBIT_STEP_DEGREES) * M_PI / 180.0;
+    Vec3 start = presetViewPositions()[0];
+
+    CheckerboardRenderer renderer(width, height);
+    for (int frame = 0; frame < frames; ++frame) {
+        Camera cam = orbitCamera(start, frame * step, RenderConfig::FOV);
+        std::vector<std::vector<Color>> image = renderer.renderFrame(cam, bh);
+
+        char filename[64];
+        std::snprintf(filename, sizeof(filename), "black_hole_preview_%03d.ppm", frame);
+        std::cout << "Frame " << (frame + 1) << "/" << frames << ": traced "
+                  << renderer.lastTracedPixels() << "/" << (long(width) * height) << " pixels\n";
+        writePPM(filename, image);
+    }
+
+    return 0;
+}
+
+/**
+ * Fly-through mode: straight dolly between two points, looking at the hole,
+ * rendered with temporal reprojection
+ */
+int runFlythroughMode(const CommandLine& args, int width, int height) {
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    int frames = std::max(1, args.getInt("frames", FlythroughConfig::DEFAULT_FRAMES));
+    Vec3 from = args.getVec3("from", Vec3(0, 4, -30));
+    Vec3 to = args.getVec3("to", Vec3(0, 2, -20));
+
+    TemporalReprojector renderer(width, height);
+    for (int frame = 0; frame < frames; ++frame) {
+        double t = frames > 1 ? double(frame) / (frames - 1) : 0.0;
+        Vec3 camPos = from + (to - from) * t;
+        Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+        std::vector<std::vector<Color>> image = renderer.renderFrame(cam, bh);
+
+        char filename[64];
+        std::snprintf(filename, sizeof(filename), "black_hole_flythrough_%03d.ppm", frame);
+        std::cout << "Frame " << (frame + 1) << "/" << frames << ": traced "
+                  << renderer.lastTracedRays() << "/" << (long(width) * height) << " rays\n";
+        writePPM(filename, image);
+    }
+
+    return 0;
+}
+
+/**
+ * Camera path mode: render a keyframed path file as a frame sequence
+ */
+int runPathMode(const CommandLine& args, int width, int height) {
+    std::string filename = args.getString("path", "");
+    CameraPath path;
+    if (filename.empty() || !path.load(filename)) {
+        std::cerr << "Could not load camera path '" << filename << "' (use --path=FILE)\n";
+        return 1;
+    }
+
+    double fps = args.getDouble("fps", BatchConfig::DEFAULT_FPS);
+    if (!(fps > 0.0)) {
+        std::cerr << "Need --fps to be positive\n";
+        return 1;
+    }
+
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    SequenceSink sink(args.getString("output", "black_hole_path"));
+    renderCameraPath(path, bh, width, height, fps, pool, sink);
+    return 0;
+}
+
+/**
+ * Sweep mode: grid over mass, disk multipliers and observer distance
+ */
+int runSweepMode(const CommandLine& args, int width, int height) {
+    std::vector<double> masses = args.getList("masses", {1.0, 2.0});
+    std::vector<double> inners = args.getList("inner", {PhysicsConstants::DISK_INNER_MULTIPLIER});
+    std::vector<double> outers = args.getList("outer", {PhysicsConstants::DISK_OUTER_MULTIPLIER});
+    std::vector<double> distances = args.getList("distances", {15.0, 30.0});
+    Vec3 view = args.getVec3("view", presetViewPositions()[0]).normalize();
+
+    std::vector<SweepConfiguration> configs;
+    for (double mass : masses) {
+        for (double inner : inners) {
+            for (double outer : outers) {
+                for (double distance : distances) {
+                    if (mass > 0.0 && distance > 0.0) {
+                        configs.push_back({mass, inner, outer, distance});
+                    }
+                }
+            }
+        }
+    }
+    if (configs.empty()) {
+        std::cerr << "Sweep grid is empty\n";
+        return 1;
+    }
+
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    renderMassSweep(configs, view, width, height, pool);
+    return 0;
+}
+
+/**
+ * Dataset mode: random scenes at small resolution into sharded binary records
+ */
+int runDatasetMode(const CommandLine& args) {
+    int width = args.getInt("width", DatasetConfig::DEFAULT_RESOLUTION);
+    int height = args.getInt("height", DatasetConfig::DEFAULT_RESOLUTION);
+    int samples = args.getInt("samples", DatasetConfig::DEFAULT_SAMPLES);
+    int shardSize = std::max(1, args.getInt("shard-size", DatasetConfig::DEFAULT_SHARD_SIZE));
+    uint64_t seed = uint64_t(args.getInt("seed", 1));
+    if (width <= 0 || height <= 0) {
+        std::cerr << "Need --width and --height to be positive\n";
+        return 1;
+    }
+
+    DatasetWriter writer(args.getString("output", "black_hole_dataset"), width, height);
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    generateDataset(samples, shardSize, seed, width, height, writer, pool);
+    return 0;
+}
+
+/**
+ * Multi-lens mode: a binary by default, or holes from --scene=FILE
+ */
+int runMultiLensMode(const CommandLine& args, int width, int height) {
+    std::vector<BlackHole> holes;
+    std::string sceneFile = args.getString("scene", "");
+    if (!sceneFile.empty()) {
+        if (!loadLensScene(sceneFile, holes)) {
+            std::cerr << "Could not load scene '" << sceneFile << "'\n";
+            return 1;
+        }
+    } else {
+        holes.emplace_back(Vec3(-14, 0, 0), 1.0);
+        holes.emplace_back(Vec3(16, 3, 8), 0.6);
+    }
+
+    LensScene scene(holes);
+    Vec3 camPos = args.getVec3("camera", scene.center() + Vec3(0, 12, -70));
+    Camera cam(camPos, (scene.center() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    renderScene(cam, scene, width, height, "black_hole_multi.ppm", pool);
+    return 0;
+}
+
+/**
+ * Microlensing mode: magnification map of a random point-lens field
+ */
+int runMicrolensMode(const CommandLine& args) {
+    int lensCount = args.getInt("lenses", MicrolensConfig::DEFAULT_LENSES);
+    double convergence = args.getDouble("convergence", MicrolensConfig::DEFAULT_CONVERGENCE);
+    double shear = args.getDouble("shear", 0.0);
+    double mapHalfWidth = args.getDouble("map-size", MicrolensConfig::DEFAULT_MAP_HALF_WIDTH);
+    int resolution = args.getInt("map", MicrolensConfig::DEFAULT_MAP_RESOLUTION);
+    double raysPerPixel = args.getDouble("rays-per-pixel", MicrolensConfig::DEFAULT_RAYS_PER_PIXEL);
+    if (lensCount <= 0 || convergence <= 0.0 || resolution <= 0) {
+        std::cerr << "Need --lenses, --convergence and --map to be positive\n";
+        return 1;
+    }
+
+    // Rays focused onto the map come from a region about 1/|1 - kappa -/+ gamma| larger
+    double focusing = std::max(0.1, std::min(std::abs(1.0 - convergence - shear), std::abs(1.0 - convergence + shear)));
+    double shootHalfWidth = MicrolensConfig::SHOOTING_MARGIN * mapHalfWidth / focusing;
+    int raysPerAxis = int(std::ceil(resolution * std::sqrt(raysPerPixel) * shootHalfWidth / mapHalfWidth));
+
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    LensTree tree(generateLensField(lensCount, convergence, uint64_t(args.getInt("seed", 1))),
+                  args.getDouble("opening-angle", MicrolensConfig::OPENING_ANGLE), pool);
+    FloatImage map = shootMagnificationMap(tree, shear, mapHalfWidth, resolution, shootHalfWidth, raysPerAxis, pool);
+    writeMagnificationMap(args.getString("output", "black_hole_microlensing"), map);
+    return 0;
+}
+
+/**
+ * Sky map mode: magnification of the celestial sphere seen by one observer
+ */
+int runSkyMapMode(const CommandLine& args) {
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 2, -30));
+    double fov = args.getDouble("fov", SkyMapConfig::DEFAULT_FOV_DEGREES) * M_PI / 180.0;
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), fov);
+
+    int raysPerAxis = args.getInt("rays", SkyMapConfig::DEFAULT_RAYS_PER_AXIS);
+    int mapWidth = args.getInt("map-width", SkyMapConfig::DEFAULT_MAP_WIDTH);
+    int mapHeight = args.getInt("map-height", SkyMapConfig::DEFAULT_MAP_HEIGHT);
+    if (raysPerAxis <= 0 || mapWidth <= 0 || mapHeight <= 0) {
+        std::cerr << "Need --rays, --map-width and --map-height to be positive\n";
+        return 1;
+    }
+
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    FloatImage map = shootSkyMagnificationMap(cam, bh, raysPerAxis, args.has("transparent-disk"),
+                                              mapWidth, mapHeight, pool);
+    writeMagnificationMap(args.getString("output", "black_hole_skymap"), map);
+    return 0;
+}
+
+/**
+ * Contour mode: shadow outline seen from --camera
+ */
+int runContourMode(const CommandLine& args, int width, int height) {
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 2, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    int angles = args.getInt("angles", ContourConfig::DEFAULT_ANGLES);
+    double tolerance = args.getDouble("tolerance", ContourConfig::DEFAULT_TOLERANCE_PIXELS);
+    if (angles <= 0 || tolerance <= 0.0) {
+        std::cerr << "Need --angles and --tolerance to be positive\n";
+        return 1;
+    }
+
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    auto start = std::chrono::steady_clock::now();
+    auto contours = extractShadowContours(cam, bh, width, height, angles, tolerance, pool);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (contours.empty()) {
+        std::cerr << "Black hole is behind the camera\n";
+        return 1;
+    }
+
+    std::cout << "Extracted " << contours.size() << " contours x " << angles << " angles in " << milliseconds
+              << " ms\n";
+    writeContours(args.getString("output", "black_hole_contours.csv"), contours);
+    return 0;
+}
+
+/**
+ * Images mode: lensed image positions and magnifications of point sources
+ */
+int runImagesMode(const CommandLine& args, int width, int height) {
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 2, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+
+    std::vector<Vec3> sources;
+    std::string sourceFile = args.getString("sources", "");
+    if (!sourceFile.empty()) {
+        if (!loadSourceDirections(sourceFile, sources)) {
+            std::cerr << "Could not load sources '" << sourceFile << "'\n";
+            return 1;
+        }
+    } else {
+        std::mt19937_64 rng(uint64_t(args.getInt("seed", 1)));
+        std::normal_distribution<double> normal(0.0, 1.0);
+        int count = args.getInt("random", ImageSolverConfig::DEFAULT_RANDOM_SOURCES);
+        for (int i = 0; i < count; ++i) {
+            sources.push_back(Vec3(normal(rng), normal(rng), normal(rng)));
+        }
+    }
+
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    auto start = std::chrono::steady_clock::now();
+    DeflectionTable table(bh, camPos.distanceTo(bh.position()), pool);
+    auto built = std::chrono::steady_clock::now();
+    std::vector<LensedImage> images = solveLensedImages(table, bh, camPos, sources, pool);
+    auto solved = std::chrono::steady_clock::now();
+
+    std::cout << "Deflection table: shadow edge at " << (table.shadowTheta() * 180.0 / M_PI) << " deg, built in "
+              << std::chrono::duration<double, std::milli>(built - start).count() << " ms\n";
+    std::cout << "Solved " << sources.size() << " sources -> " << images.size() << " images in "
+              << std::chrono::duration<double, std::milli>(solved - built).count() << " ms\n";
+
+    std::string filename = args.getString("output", "black_hole_images.csv");
+    std::ofstream file(filename);
+    file << "source,order,x,y,in_frame,magnification,parity\n";
+    for (const LensedImage& image : images) {
+        double x, y;
+        if (!cam.projectDirection(image.direction, width, height, x, y)) {
+            continue;
+        }
+        bool inFrame = x >= 0.0 && y >= 0.0 && x < width && y < height;
+        file << image.source << "," << image.order << "," << x << "," << y << "," << (inFrame ? 1 : 0) << ","
+             << image.magnification << "," << image.parity << "\n";
+    }
+    file.close();
+    std::cout << "Saved " << filename << "\n";
+    return 0;
+}
+
+/**
+ * Sky background selected by --sky (procedural by default)
+ */
+std::unique_ptr<SkyBackground> makeSkyBackground(const CommandLine& args, ThreadPool& pool) {
+    std::string kind = args.getString("sky", "procedural");
+    if (kind == "catalog") {
+        auto sky = std::make_unique<CatalogSky>();
+        std::string filename = args.getString("catalog", "stars.bhsc");
+        if (!sky->open(filename)) {
+            std::cerr << "Could not open star catalog '" << filename << "'\n";
+            return nullptr;
+        }
+        std::cout << "Mapped " << sky->starCount() << " stars from " << filename << "\n";
+        return sky;
+    }
+    if (kind == "envmap") {
+        auto sky = std::make_unique<EnvironmentMapSky>();
+        std::string filename = args.getString("envmap", "sky.bhem");
+        if (!sky->open(filename)) {
+            std::cerr << "Could not open environment map '" << filename << "'\n";
+            return nullptr;
+        }
+        std::cout << "Mapped " << sky->width() << "x" << sky->height() << " environment map from " << filename
+                  << "\n";
+        return sky;
+    }
+    if (kind == "baked") {
+        auto sky = std::make_unique<CubemapSky>();
+        if (!sky->open(args.getString("sky-cache", "."), args.getInt("cubemap-size", CubemapConfig::DEFAULT_FACE_SIZE),
+                       pool)) {
+            std::cerr << "Could not bake or map the procedural sky (--cubemap-size must be a power of two)\n";
+            return nullptr;
+        }
+        return sky;
+    }
+    if (kind == "procedural") {
+        return std::make_unique<ProceduralSky>();
+    }
+    std::cerr << "Unknown sky: " << kind << "\n";
+    return nullptr;
+}
+
+/**
+ * Sky mode: one view rendered at 1 spp against the selected sky
+ */
+int runSkyMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    std::unique_ptr<SkyBackground> sky = makeSkyBackground(args, pool);
+    if (!sky) {
+        return 1;
+    }
+
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 2, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    renderWithSky(cam, bh, *sky, width, height, args.getString("output", "black_hole_sky.ppm"), pool);
+    return 0;
+}
+
+/**
+ * Environment map mode: convert a PFM panorama into a mip-chained map
+ */
+int runEnvironmentMapMode(const CommandLine& args) {
+    std::string input = args.getString("input", "");
+    std::string output = args.getString("output", "sky.bhem");
+    if (input.empty()) {
+        std::cerr << "Need --input=FILE.pfm\n";
+        return 1;
+    }
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    if (!convertEnvironmentMap(input, output, pool)) {
+        std::cerr << "Could not convert '" << input << "' to '" << output << "'\n";
+        return 1;
+    }
+    std::cout << "Saved " << output << "\n";
+    return 0;
+}
+
+/**
+ * Splat mode: catalog stars forward-mapped through the lens onto one view
+ */
+int runSplatMode(const CommandLine& args, int width, int height) {
+    CatalogSky catalog;
+    std::string filename = args.getString("catalog", "stars.bhsc");
+    if (!catalog.open(filename)) {
+        std::cerr << "Could not open star catalog '" << filename << "'\n";
+        return 1;
+    }
+
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 2, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    renderSplattedStars(cam, bh, catalog, width, height, args.getString("output", "black_hole_splat.ppm"), pool);
+    return 0;
+}
+
+/**
+ * Catalog mode: convert a CSV star list into the binary HEALPix catalog
+ */
+int runCatalogMode(const CommandLine& args) {
+    std::string input = args.getString("input", "");
+    std::string output = args.getString("output", "stars.bhsc");
+    int nside = args.getInt("nside", CatalogConfig::DEFAULT_NSIDE);
+    if (input.empty() || nside <= 0 || (nside & (nside - 1)) != 0 || uint32_t(nside) > CatalogConfig::MAX_NSIDE) {
+        std::cerr << "Need --input=FILE.csv and a power-of-two --nside up to " << CatalogConfig::MAX_NSIDE << "\n";
+        return 1;
+    }
+    if (!convertStarCatalog(input, output, uint32_t(nside))) {
+        std::cerr << "Could not convert '" << input << "' to '" << output << "'\n";
+        return 1;
+    }
+    std::cout << "Saved " << output << "\n";
+    return 0;
+}
+
+/**
+ * Kerr mode: one view of a rotating hole at 1 sample per pixel
+ */
+int runKerrMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    std::unique_ptr<SkyBackground> sky = makeSkyBackground(args, pool);
+    if (!sky) {
+        return 1;
+    }
+
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    KerrBlackHole kerr(bh, args.getDouble("spin", KerrConfig::DEFAULT_SPIN));
+    std::cout << "Spin a/M = " << kerr.spin() << ", horizon r+ = " << kerr.horizonRadius() << ", ISCO = "
+              << kerr.iscoRadius() << "\n";
+
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 2, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    renderWithSky(cam, bh, *sky, width, height, args.getString("output", "black_hole_kerr.ppm"), pool,
+                  [&kerr](const Vec3& origin, const Vec3& direction) { return kerr.trace(origin, direction); });
+    return 0;
+}
+
+/**
+ * Thick disk mode: one view of a volumetric accretion flow at 1 sample per pixel
+ */
+int runThickDiskMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    std::unique_ptr<SkyBackground> sky = makeSkyBackground(args, pool);
+    if (!sky) {
+        return 1;
+    }
+
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    ThickDisk disk(bh, args.getDouble("thickness", ThickDiskConfig::DEFAULT_ASPECT),
+                   args.getDouble("opacity", ThickDiskConfig::DEFAULT_OPACITY));
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 6, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    renderWithSky(cam, bh, *sky, width, height, args.getString("output", "black_hole_thick.ppm"), pool,
+                  [&](const Vec3& origin, const Vec3& direction) {
+                      return traceThickDisk(origin, direction, bh, disk);
+                  });
+    return 0;
+}
+
+/**
+ * Volume mode: convert a raw simulation snapshot into a bricked volume
+ */
+int runVolumeMode(const CommandLine& args) {
+    std::string input = args.getString("input", "");
+    std::string output = args.getString("output", "snapshot.bhgv");
+    std::vector<double> dims = args.getList("dims", {});
+    double extent = args.getDouble("extent", 0.0);
+    int brickSize = args.getInt("brick-size", GrmhdConfig::DEFAULT_BRICK_SIZE);
+    if (input.empty() || dims.size() != 3 || dims[0] < 1 || dims[1] < 1 || dims[2] < 1 || extent <= 0.0 ||
+        brickSize < 2 || brickSize > int(GrmhdConfig::MAX_BRICK_SIZE)) {
+        std::cerr << "Need --input=FILE.raw --dims=NX,NY,NZ --extent=HALF_WIDTH and --brick-size in [2, "
+                  << GrmhdConfig::MAX_BRICK_SIZE << "]\n";
+        return 1;
+    }
+
+    uint32_t size[3] = {uint32_t(dims[0]), uint32_t(dims[1]), uint32_t(dims[2])};
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    if (!convertVolume(input, output, size, extent, brickSize, pool)) {
+        std::cerr << "Could not convert '" << input << "' to '" << output << "'\n";
+        return 1;
+    }
+    std::cout << "Saved " << output << "\n";
+    return 0;
+}
+
+/**
+ * GRMHD mode: render a bricked simulation volume at 1 sample per pixel
+ */
+int runGrmhdMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    std::unique_ptr<SkyBackground> sky = makeSkyBackground(args, pool);
+    if (!sky) {
+        return 1;
+    }
+
+    std::string filename = args.getString("volume", "snapshot.bhgv");
+    size_t cacheBytes = size_t(std::max(1, args.getInt("cache-mb", int(GrmhdConfig::DEFAULT_CACHE_MB)))) << 20;
+    BrickedVolume volume;
+    if (!volume.open(filename, cacheBytes)) {
+        std::cerr << "Could not open volume '" << filename << "'\n";
+        return 1;
+    }
+    const VolumeHeader& header = volume.header();
+    std::cout << "Volume " << header.dims[0] << "x" << header.dims[1] << "x" << header.dims[2] << " in "
+              << header.bricks[0] * header.bricks[1] * header.bricks[2] << " bricks\n";
+
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    double opacity = args.getDouble("opacity", GrmhdConfig::DEFAULT_OPACITY);
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 6, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    renderWithSky(cam, bh, *sky, width, height, args.getString("output", "black_hole_grmhd.ppm"), pool,
+                  [&](const Vec3& origin, const Vec3& direction) {
+                      return traceVolume(origin, direction, bh, volume, opacity);
+                  });
+
+    uint64_t hits = volume.cacheHits(), misses = volume.cacheMisses();
+    std::cout << "Brick cache: " << hits << " hits, " << misses << " misses ("
+              << (hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0) << "% hit rate)\n";
+    return 0;
+}
+
+/**
+ * Light curve mode: flux of an orbiting hotspot over many time steps from
+ * one traced lensing map
+ */
+int runLightCurveMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    KerrBlackHole kerr(bh, args.getDouble("spin", 0.0));
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 6, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+
+    LensingMapHeader header = {};
+    std::memcpy(header.magic, "BHLM", 4);
+    header.version = LightCurveConfig::FORMAT_VERSION;
+    header.width = uint32_t(width);
+    header.height = uint32_t(height);
+    header.spin = kerr.spin();
+    header.camera[0] = camPos.x();
+    header.camera[1] = camPos.y();
+    header.camera[2] = camPos.z();
+    header.fieldOfView = cam.fieldOfView();
+
+    auto start = std::chrono::steady_clock::now();
+    LensingMap map;
+    std::string mapFile = args.getString("lensing-map", "");
+    if (!mapFile.empty() && map.load(mapFile, header)) {
+        std::cout << "Loaded lensing map " << mapFile << "\n";
+    } else {
+        std::cout << "Tracing " << width << "x" << height << " lensing map...\n";
+        map.trace(cam, kerr, bh, width, height, pool);
+        if (!mapFile.empty() && map.save(mapFile, header)) {
+            std::cout << "Saved " << mapFile << "\n";
+        }
+    }
+    auto mapped = std::chrono::steady_clock::now();
+
+    double orbitRadius = args.getDouble("radius", LightCurveConfig::DEFAULT_RADIUS);
+    if (orbitRadius < kerr.iscoRadius()) {
+        std::cerr << "Spot orbit radius must be at least the ISCO (" << kerr.iscoRadius() << ")\n";
+        return 1;
+    }
+    HotspotLightCurve curve(map, bh.mass(), kerr.spin(), orbitRadius,
+                            args.getDouble("spot-size", LightCurveConfig::DEFAULT_SPOT_SIZE));
+    int steps = std::max(1, args.getInt("steps", LightCurveConfig::DEFAULT_STEPS));
+    double duration = args.getDouble("periods", LightCurveConfig::DEFAULT_PERIODS) * curve.period();
+
+    // Pixel solid angle near the image centre, so flux is per steradian. The
+    // camera keeps an aspect ratio of 1, so pixels are 2 tan(fov / 2) / width
+    // wide and 2 tan(fov / 2) / height tall.
+    double frameSpan = 2.0 * std::tan(cam.fieldOfView() * 0.5);
+    double pixelSolidAngle = (frameSpan / map.width) * (frameSpan / map.height);
+    std::vector<double> flux(steps);
+    parallelFor(pool, steps, [&](int i) {
+        flux[i] = curve.flux(duration * i / steps) * pixelSolidAngle;
+    });
+    auto done = std::chrono::steady_clock::now();
+
+    std::string filename = args.getString("output", "black_hole_lightcurve.csv");
+    std::ofstream out(filename);
+    out << "time,phase,flux\n";
+    for (int i = 0; i < steps; ++i) {
+        double t = duration * i / steps;
+        out << t << "," << t / curve.period() << "," << flux[i] << "\n";
+    }
+
+    std::cout << "Map " << std::chrono::duration<double, std::milli>(mapped - start).count() << " ms, "
+              << steps << " steps over " << curve.pixels() << " spot pixels in "
+              << std::chrono::duration<double, std::milli>(done - mapped).count() << " ms (period "
+              << curve.period() << " M)\n";
+    std::cout << "Saved " << filename << "\n";
+    return 0;
+}
+
+/**
+ * Bands mode: trace one view once and shade it in several spectral bands,
+ * each written as its own PFM
+ */
+int runBandsMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    KerrBlackHole kerr(bh, args.getDouble("spin", 0.0));
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 6, -30));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+
+    std::vector<SpectralBand> bands;
+    if (!parseSpectralBands(args.getString("bands", "radio,ir,optical,xray"), bands)) {
+        return 1;
+    }
+    if (bands.empty()) {
+        std::cerr << "Need --bands from radio, ir, optical, xray\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SpectralHits hits = traceSpectralHits(cam, kerr, bh, width, height, pool);
+    auto traced = std::chrono::steady_clock::now();
+    FloatImage image = shadeSpectralBands(hits, bands, kerr.iscoRadius(), pool);
+    auto shaded = std::chrono::steady_clock::now();
+    std::cout << "Traced " << width << "x" << height << " in "
+              << std::chrono::duration<double, std::milli>(traced - start).count() << " ms, shaded " << bands.size()
+              << " bands in " << std::chrono::duration<double, std::milli>(shaded - traced).count() << " ms\n";
+
+    std::string prefix = args.getString("output", "black_hole_band_");
+    for (size_t b = 0; b < bands.size(); ++b) {
+        writePFM(prefix + bands[b].name + ".pfm", image.channel(int(b)));
+    }
+    return 0;
+}
+
+/**
+ * Particles mode: a test-particle accretion flow rendered frame by frame
+ */
+int runParticlesMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    int count = std::max(1, args.getInt("particles", ParticleConfig::DEFAULT_PARTICLES));
+    auto start = std::chrono::steady_clock::now();
+    ParticleDisk disk(bh, count, uint64_t(args.getInt("seed", 1)));
+    std::cout << "Seeded " << count << " particles in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms\n";
+
+    Vec3 camPos = args.getVec3("camera", Vec3(0, 12, -24));
+    Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+    renderParticleDisk(cam, bh, disk, width, height, std::max(1, args.getInt("frames", ParticleConfig::DEFAULT_FRAMES)),
+                       std::max(1, args.getInt("substeps", ParticleConfig::DEFAULT_SUBSTEPS)),
+                       args.getString("output", "black_hole_particles_"), pool);
+    return 0;
+}
+
+/**
+ * Multi-view mode: stereo pairs or a row of light-field views sharing one
+ * geodesic table
+ */
+int runMultiViewMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    BlackHole bh(Vec3(0, 0, 0), 1.0);
+    int count = std::max(1, args.getInt("views", MultiViewConfig::DEFAULT_VIEWS));
+    double baseline = args.getDouble("baseline", MultiViewConfig::DEFAULT_BASELINE);
+
+    // Parallel-axis eyes spread along the center camera's right vector
+    Vec3 center = args.getVec3("camera", presetViewPositions()[0]);
+    Vec3 camDir = (bh.position() - center).normalize();
+    Vec3 right = camDir.cross(Vec3(0, 1, 0)).normalize();
+    std::vector<Camera> views;
+    for (int i = 0; i < count; ++i) {
+        double offset = count > 1 ? (double(i) / (count - 1) - 0.5) * baseline : 0.0;
+        views.emplace_back(center + right * offset, camDir, Vec3(0, 1, 0), RenderConfig::FOV);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<std::vector<Color>>> images = renderMultiView(views, bh, width, height, pool);
+    double shared = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::string prefix = args.getString("output", "black_hole_view_");
+    for (size_t i = 0; i < images.size(); ++i) {
+        writePPM(prefix + std::to_string(i + 1) + ".ppm", images[i]);
+    }
+
+    // Optionally render every view directly, as render() does, to compare
+    if (args.has("reference")) {
+        start = std::chrono::steady_clock::now();
+        std::vector<double> rowDifference(size_t(height) * views.size(), 0.0);
+        for (size_t i = 0; i < views.size(); ++i) {
+            parallelFor(pool, height, [&](int y) {
+                for (int x = 0; x < width; ++x) {
+                    Color direct = traceSupersampledPixel(views[i], bh, x, y, width, height).enhanceContrast().clamp();
+                    const Color& shared = images[i][y][x];
+                    rowDifference[i * height + y] += std::abs(direct.r() - shared.r()) +
+                                                     std::abs(direct.g() - shared.g()) +
+                                                     std::abs(direct.b() - shared.b());
+                }
+            });
+        }
+        double direct = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        double difference = 0.0;
+        for (double row : rowDifference) {
+            difference += row;
+        }
+        difference /= 3.0 * width * height * views.size();
+        std::cout << "Shared table: " << shared << " ms, direct tracing: " << direct
+                  << " ms, mean absolute difference " << difference << "\n";
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Interferometry mode: visibilities and beam-convolved images for a
+ * sequence of float frames, either PFM files or the spectral bands of one
+ * traced view
+ */
+int runInterferometryMode(const CommandLine& args, int width, int height) {
+    ThreadPool pool(threadCountOption(args.getInt("threads", 0)));
+    std::vector<FloatImage> frames;
+    std::vector<std::string> names;
+
+    if (args.has("input")) {
+        std::istringstream files(args.getString("input", ""));
+        std::string file;
+        while (std::getline(files, file, ',')) {
+            FloatImage frame;
+            if (!readPFM(file, frame) || (!frames.empty() && (frame.width != frames[0].width ||
+                                                              frame.height != frames[0].height))) {
+                std::cerr << "Cannot read " << file << " as a PFM matching the first frame\n";
+                return 1;
+            }
+            frames.push_back(frame.channel(std::min(std::max(0, args.getInt("channel", 0)), frame.channels - 1)));
+            names.push_back(file);
+        }
+    } else {
+        BlackHole bh(Vec3(0, 0, 0), 1.0);
+        KerrBlackHole kerr(bh, args.getDouble("spin", 0.0));
+        Vec3 camPos = args.getVec3("camera", Vec3(0, 6, -30));
+        Camera cam(camPos, (bh.position() - camPos).normalize(), Vec3(0, 1, 0), RenderConfig::FOV);
+        std::vector<SpectralBand> bands;
+        if (!parseSpectralBands(args.getString("bands", "radio,ir,optical,xray"), bands)) {
+            return 1;
+        }
+        SpectralHits hits = traceSpectralHits(cam, kerr, bh, width, height, pool);
+        FloatImage image = shadeSpectralBands(hits, bands, kerr.iscoRadius(), pool);
+        for (size_t b = 0; b < bands.size(); ++b) {
+            frames.push_back(image.channel(int(b)));
+            names.push_back(bands[b].name);
+        }
+    }
+    if (frames.empty()) {
+        std::cerr << "No frames to observe\n";
+        return 1;
+    }
+
+    // Cameras keep an aspect ratio of 1, so a frame spans the same angle
+    // across its width and height and pixels are non-square
+    double frameSpan = 2.0 * std::tan(RenderConfig::FOV * 0.5);
+    std::vector<double> pixelAngles = args.getList("pixel-angle", {frameSpan / frames[0].width,
+                                                                   frameSpan / frames[0].height});
+    double angleX = pixelAngles.empty() ? 0.0 : pixelAngles[0];
+    double angleY = pixelAngles.size() > 1 ? pixelAngles[1] : angleX;
+    if (angleX <= 0.0 || angleY <= 0.0) {
+        std::cerr << "Need --pixel-angle=AX[,AY] to be positive\n";
+        return 1;
+    }
+    std::vector<std::pair<double, double>> uv;
+    std::vector<double> pairs = args.getList("uv", {});
+    for (size_t i = 0; i + 1 < pairs.size(); i += 2) {
+        uv.emplace_back(pairs[i], pairs[i + 1]);
+    }
+    if (uv.empty()) {
+        uv = defaultUvCoverage(std::max(angleX, angleY));
+    }
+
+    SyntheticObservation observation(frames[0].width, frames[0].height, angleX, angleY,
+                                     args.getInt("padding", InterferometryConfig::DEFAULT_PADDING),
+                                     args.getDouble("beam", InterferometryConfig::DEFAULT_BEAM_FWHM * angleY));
+    std::string prefix = args.getString("output", "black_hole_");
+    std::ofstream csv(prefix + "visibilities.csv");
+    csv << "frame,u,v,real,imag,amplitude,phase\n";
+    for (size_t f = 0; f < frames.size(); ++f) {
+        auto start = std::chrono::steady_clock::now();
+        SyntheticObservation::Result result = observation.observe(frames[f], 0, uv, pool);
+        std::cout << "Observed " << names[f] << " on a " << observation.gridWidth() << "x"
+                  << observation.gridHeight() << " grid in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms\n";
+        for (size_t i = 0; i < uv.size(); ++i) {
+            const auto& v = result.visibilities[i];
+            csv << names[f] << "," << uv[i].first << "," << uv[i].second << "," << v.real() << "," << v.imag()
+                << "," << std::abs(v) << "," << std::arg(v) << "\n";
+        }
+        writePFM(prefix + "beam_" + std::to_string(f + 1) + ".pfm", result.convolved);
+    }
+    csv.close();
+    std::cout << "Saved " << prefix << "visibilities.csv\n";
+    return 0;
+}
+
+/**
+ * Main entry point
+ *
+ * Usage: blackhole [--mode=render|upscale|quadtree|preview|flythrough|path|sweep|dataset|multi|microlens|skymap|contour|images|sky|catalog|splat|envmap|kerr|thick|volume|grmhd|lightcurve|bands|particles|multiview|interferometry] [--width=W] [--height=H]
+ *                  [--factor=N] [--frames=N] [--orbit-step=DEGREES] [--from=X,Y,Z] [--to=X,Y,Z]
+ *                  [--path=FILE] [--fps=F] [--threads=N] [--output=PREFIX]
+ *                  [--masses=M,...] [--inner=K,...] [--outer=K,...] [--distances=D,...] [--view=X,Y,Z]
+ *                  [--samples=N] [--shard-size=N] [--seed=S] [--scene=FILE] [--camera=X,Y,Z]
+ *                  [--lenses=N] [--convergence=K] [--shear=G] [--map=N] [--map-size=R] [--rays-per-pixel=N]
+ *                  [--rays=N] [--fov=DEGREES] [--map-width=W] [--map-height=H] [--transparent-disk]
+ *                  [--angles=N] [--tolerance=PIXELS] [--sources=FILE] [--random=N]
+ *                  [--sky=procedural|catalog|envmap|baked] [--catalog=FILE] [--envmap=FILE] [--input=FILE] [--nside=N]
+ *                  [--sky-cache=DIR] [--cubemap-size=N] [--spin=A]
+ *                  [--thickness=H] [--opacity=K] [--dims=NX,NY,NZ] [--extent=L] [--brick-size=N]
+ *                  [--volume=FILE] [--cache-mb=N] [--radius=R] [--spot-size=S] [--steps=N] [--periods=P]
+ *                  [--lensing-map=FILE] [--bands=radio,ir,optical,xray]
+ *                  [--particles=N] [--substeps=N] [--views=N] [--baseline=B] [--reference]
+ *                  [--input=A.pfm,B.pfm] [--uv=U1,V1,U2,V2] [--beam=FWHM] [--padding=N] [--pixel-angle=AX,AY]
+ */
+int main(int argc, char* argv[]) {
+    std::cout << "Black Hole Raytracer v2.0 - Maxwell Corwin\n";
+    std::cout << "Enhanced with anti-aliasing, lens flares, and particle effects\n";
+
+    CommandLine args(argc, argv);
+    std::string mode = args.getString("mode", "render");
+    int width = args.getInt("width", RenderConfig::WIDTH);
+    int height = args.getInt("height", RenderConfig::HEIGHT);
+    if (width <= 0 || height <= 0) {
+        std::cerr << "Need --width and --height to be positive\n";
+        return 1;
+    }
+
+    if (mode == "render" || mode == "upscale" || mode == "quadtree") {
+        return runViewsMode(mode, args, width, height);
+    } else if (mode == "preview") {
+        return runPreviewMode(args, width, height);
+    } else if (mode == "flythrough") {
+        return runFlythroughMode(args, width, height);
+    } else if (mode == "path") {
+        return runPathMode(args, width, height);
+    } else if (mode == "sweep") {
+        return runSweepMode(args, width, height);
+    } else if (mode == "dataset") {
+        return runDatasetMode(args);
+    } else if (mode == "multi") {
+        return runMultiLensMode(args, width, height);
+    } else if (mode == "microlens") {
+        return runMicrolensMode(args);
+    } else if (mode == "skymap") {
+        return runSkyMapMode(args);
+    } else if (mode == "contour") {
+        return runContourMode(args, width, height);
+    } else if (mode == "images") {
+        return runImagesMode(args, width, height);
+    } else if (mode == "sky") {
+        return runSkyMode(args, width, height);
+    } else if (mode == "catalog") {
+        return runCatalogMode(args);
+    } else if (mode == "splat") {
+        return runSplatMode(args, width, height);
+    } else if (mode == "envmap") {
+        return runEnvironmentMapMode(args);
+    } else if (mode == "kerr") {
+        return runKerrMode(args, width, height);
+    } else if (mode == "thick") {
+        return runThickDiskMode(args, width, height);
+    } else if (mode == "volume") {
+        return runVolumeMode(args);
+    } else if (mode == "grmhd") {
+        return runGrmhdMode(args, width, height);
+    } else if (mode == "lightcurve") {
+        return runLightCurveMode(args, width, height);
+    } else if (mode == "bands") {
+        return runBandsMode(args, width, height);
+    } else if (mode == "particles") {
+        return runParticlesMode(args, width, height);
+    } else if (mode == "multiview") {
+        return runMultiViewMode(args, width, height);
+    } else if (mode == "interferometry") {
+        return runInterferometryMode(args, width, height);
+    }
+
+    std::cerr << "Unknown mode: " << mode << "\n";
+    return 1;
+}